@@ -0,0 +1,39 @@
+#ifndef autotune_h
+#define autotune_h
+
+#include <stdint.h>
+#include "reflowtoasteroven.h" // for settings_t, AUTOTUNE
+
+#define AUTOTUNE_RUNNING 0
+#define AUTOTUNE_DONE 1
+#define AUTOTUNE_FAILED 2
+
+#define AUTOTUNE_HYSTERESIS 10 // 0.1 C around the setpoint, keeps noise from toggling the relay
+#define AUTOTUNE_SKIP 2		  // cycles to let the oscillation settle before measuring
+#define AUTOTUNE_CYCLES 3	  // cycles that are averaged
+#define AUTOTUNE_TIMEOUT ((uint16_t)(30 * 60 / (TMR_OVF_TIMESPAN * 256))) // give up after half an hour
+
+// state of a relay feedback experiment, one temperature check at a time (like reflow_t)
+typedef struct
+{
+	char state;			  // AUTOTUNE_RUNNING, AUTOTUNE_DONE or AUTOTUNE_FAILED
+	char high;			  // relay output is high
+	uint8_t cycles;		  // rising edges of the relay output so far
+	int16_t setpoint;	  // 0.1 C
+	int16_t limit;		  // 0.1 C, fail above this
+	uint16_t bias;		  // PWM in the middle of the relay output
+	uint16_t amplitude;	  // PWM the relay output is above and below bias
+	uint16_t tick;		  // temperature checks since the start
+	uint16_t last_rise;	  // tick of the last rising edge
+	int16_t top;		  // highest reading in the current cycle
+	int16_t bottom;		  // lowest reading in the current cycle
+	uint16_t period_sum;  // ticks, of the measured cycles
+	uint16_t height_sum;  // 0.1 C peak to peak, of the measured cycles
+	uint16_t pwm_ocr;	  // PWM duty cycle for the heating element
+} autotune_t;
+
+void autotune_init(autotune_t *t, double temp);
+void autotune_step(autotune_t *t, int16_t cur_temp);
+char autotune_result(autotune_t *t, settings_t *s);
+
+#endif
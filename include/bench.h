@@ -0,0 +1,12 @@
+#ifndef bench_h
+#define bench_h
+
+#include "reflowtoasteroven.h" // for BENCHMARK
+
+#if BENCHMARK
+
+void bench_run() __attribute__((noreturn)); // prints the cycle counts of the hot paths, then stops the CPU
+
+#endif
+
+#endif
@@ -0,0 +1,106 @@
+/* Board definition
+ *
+ * Every pin the firmware drives or reads itself, for each board it can be built for. BOARD in
+ * reflowtoasteroven.h picks one, so porting is a block here and a -DBOARD= in platformio.ini.
+ *
+ * A pin is a type, io_pin<port, bit>. Its functions work on constant register addresses, so
+ * set() and clear() compile to a single sbi or cbi, without the pin table lookups of pinMode and
+ * digitalWrite. arduino is the Arduino pin number, for Encoder and U8glib that want one.
+ */
+
+#ifndef board_h
+#define board_h
+
+#include <avr/io.h>
+#include <stdint.h>
+#include "reflowtoasteroven.h" // for BOARD
+
+#define BOARD_OVEN 1   // the oven board, ATmega328 on its 8 MHz internal oscillator
+#define BOARD_NANO16 2 // an Arduino Nano or Uno, 16 MHz crystal, wired to the same Arduino pins
+
+enum io_port_name
+{
+	IO_PORT_B,
+	IO_PORT_C,
+	IO_PORT_D
+};
+
+template <io_port_name P>
+struct io_port;
+
+template <>
+struct io_port<IO_PORT_B>
+{
+	static volatile uint8_t &out() { return PORTB; }
+	static volatile uint8_t &dir() { return DDRB; }
+	static volatile uint8_t &in() { return PINB; }
+	static constexpr uint8_t arduino_first = 8; // Arduino pin number of bit 0
+};
+
+template <>
+struct io_port<IO_PORT_C>
+{
+	static volatile uint8_t &out() { return PORTC; }
+	static volatile uint8_t &dir() { return DDRC; }
+	static volatile uint8_t &in() { return PINC; }
+	static constexpr uint8_t arduino_first = 14; // A0
+};
+
+template <>
+struct io_port<IO_PORT_D>
+{
+	static volatile uint8_t &out() { return PORTD; }
+	static volatile uint8_t &dir() { return DDRD; }
+	static volatile uint8_t &in() { return PIND; }
+	static constexpr uint8_t arduino_first = 0;
+};
+
+template <io_port_name P, uint8_t B>
+struct io_pin
+{
+	static constexpr uint8_t arduino = io_port<P>::arduino_first + B;
+
+	static void output() { io_port<P>::dir() |= _BV(B); }
+	static void input_pullup()
+	{
+		io_port<P>::dir() &= ~_BV(B);
+		io_port<P>::out() |= _BV(B);
+	}
+	static void set() { io_port<P>::out() |= _BV(B); }
+	static void clear() { io_port<P>::out() &= ~_BV(B); }
+	static char is_low() { return bit_is_clear(io_port<P>::in(), B) != 0; }
+};
+
+// the hardware SPI of the ATmega328, the same on every board
+typedef io_pin<IO_PORT_B, 5> pin_spi_sck;
+typedef io_pin<IO_PORT_B, 3> pin_spi_mosi; // not connected, the converters only talk back
+typedef io_pin<IO_PORT_B, 2> pin_spi_ss;   // has to be an output, or the SPI drops out of master mode
+
+#if BOARD == BOARD_OVEN || BOARD == BOARD_NANO16
+
+typedef io_pin<IO_PORT_D, 6> pin_heater;	// solid state relay of the heating element, high is on
+typedef io_pin<IO_PORT_D, 5> pin_buzzer;	// high beeps
+typedef io_pin<IO_PORT_D, 4> pin_button;	// push button of the rotary encoder, low when pressed
+typedef io_pin<IO_PORT_D, 2> pin_encoder_a; // the encoder needs the INT0 and INT1 pins
+typedef io_pin<IO_PORT_D, 3> pin_encoder_b;
+typedef io_pin<IO_PORT_C, 3> pin_lcd_sck;	// ST7920 in serial mode: E
+typedef io_pin<IO_PORT_C, 5> pin_lcd_mosi;	// R/W
+typedef io_pin<IO_PORT_C, 4> pin_lcd_cs;	// RS
+typedef io_pin<IO_PORT_B, 2> pin_tc_cs;		// chip select of an SPI thermocouple converter, also the SPI SS pin
+typedef io_pin<IO_PORT_B, 1> pin_tc_cs_air; // of the second one, see SENSOR_CHANNELS
+
+#else
+#error "unknown BOARD, see board.h"
+#endif
+
+#if BOARD == BOARD_OVEN
+#define BOARD_F_CPU 8000000UL
+#else
+#define BOARD_F_CPU 16000000UL
+#endif
+
+#if F_CPU != BOARD_F_CPU
+#error "board_build.f_cpu in platformio.ini does not match the BOARD"
+#endif
+
+#endif
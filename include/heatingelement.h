@@ -30,10 +30,7 @@
 
 #include <avr/io.h>
 
-// define the pin location for the connection to the relay
-#define PWM_PORTx PORTD
-#define PWM_DDRx DDRD
-#define PWM_PIN 6
+// the relay is on pin_heater, see board.h
 
 void heat_init();
 void heat_isr();
@@ -0,0 +1,17 @@
+#ifndef meminfo_h
+#define meminfo_h
+
+#include <stdint.h>
+#include "reflowtoasteroven.h" // for STACK_MONITOR
+
+#define STACK_CANARY 0xC5 // what the free RAM is painted with at reset
+
+#if STACK_MONITOR
+
+uint16_t mem_static();		 // bytes of .data, .bss and .noinit, tools/sizereport.py tells which module has them
+uint16_t mem_free();		 // bytes between the heap and the stack right now
+uint16_t mem_stack_unused(); // bytes of the free RAM the stack has never reached since reset, the headroom
+
+#endif
+
+#endif
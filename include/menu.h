@@ -2,6 +2,7 @@
 #define menu_h
 
 #include "reflowtoasteroven.h" // for profile_t
+#include "reflowcontrol.h" // for reflow_t
 
  // changes a value based on the up and down buttons
 double button_change_double(double oldvalue, double increment, double limit1, double limit2);
@@ -11,8 +12,13 @@ char* str_from_double(double value, int decimalplaces);
 void menu_manual_pwm_ctrl();
 void menu_manual_temp_ctrl();
 void menu_edit_profile(profile_t* profile);
+const char* segment_name(uint8_t type);
+void menu_select_profile();
 void menu_auto_mode();
 void menu_edit_settings();
+void menu_autotune();
+void menu_calibrate();
 void main_menu();
+void auto_draw(reflow_t* r, int16_t cur_temp); // in main.cpp, next to auto_go
  
  #endif
\ No newline at end of file
@@ -29,14 +29,72 @@
 #define nvm_h
 
 #include "reflowtoasteroven.h"
+#include "temperaturemeasurement.h" // for calibration_t
 
+#define PROFILE_SLOTS 4					// number of profiles kept in EEPROM
+#define PROFILE_NAME_SIZE 10			// characters in a profile name, without the terminating 0
+
+// layout versions of the records, see nvm.cpp
+// only bumped when a field changes meaning, fields added at the end of a struct do not need a new version
+#define SETTINGS_VERSION 2 // 1 had the gains per AD595 count, see settings_load()
+#define PROFILE_VERSION 1
+#define PROFILE_DIR_VERSION 1
+#define CALIBRATION_VERSION 1
+
+// what the profile menu needs to know about all slots, so it does not have to read every profile
+typedef struct
+{
+	uint8_t selected;							 // only used until the state ring has an entry, see nvm_state_t
+	uint8_t valid;								 // a bit per slot, set once it has been saved
+	char name[PROFILE_SLOTS][PROFILE_NAME_SIZE]; // 0 terminated if shorter
+} profile_dir_t;
+
+// what changes often, kept in a ring of records so every save goes to the next cell, see nvm.cpp
+typedef struct
+{
+	uint16_t runs;		// automatic runs started
+	uint8_t selected;	// the slot profile_load() and profile_save() use
+} nvm_state_t;
+
+#define NVM_STATE_ENTRIES 8				// entries in the ring, each cell is written this many times less often
+#define NVM_QUEUE_SIZE 112				// bytes of writes that can wait for the EEPROM, room for two records and a few more
+
+// fixed places, so a struct that grows does not move the records after it
 #define EEPROM_SETTINGS_ADDR ((uint8_t*)+0) // cannot just be 0, has to specify it is a pointer, because it is used as a pointer later and if unspecified defaults to unsigned long long.
-#define EEPROM_PROFILE_ADDR  (EEPROM_SETTINGS_ADDR + 2 + sizeof(settings_t))
+#define EEPROM_SETTINGS_SIZE 64
+#define EEPROM_PROFILE_DIR_ADDR (EEPROM_SETTINGS_ADDR + EEPROM_SETTINGS_SIZE)
+#define EEPROM_PROFILE_DIR_SIZE 48
+#define EEPROM_PROFILE_ADDR (EEPROM_PROFILE_DIR_ADDR + EEPROM_PROFILE_DIR_SIZE)
+#define EEPROM_PROFILE_SLOT_SIZE 48
+#define EEPROM_STATE_ADDR (EEPROM_PROFILE_ADDR + PROFILE_SLOTS * EEPROM_PROFILE_SLOT_SIZE)
+#define EEPROM_STATE_ENTRY_SIZE (1 + sizeof(nvm_state_t) + 2) // sequence number, state and CRC
+#define EEPROM_CALIBRATION_ADDR (EEPROM_STATE_ADDR + NVM_STATE_ENTRIES * EEPROM_STATE_ENTRY_SIZE)
+#define EEPROM_CALIBRATION_SIZE 32
+#define EEPROM_RECORDER_ADDR (EEPROM_CALIBRATION_ADDR + EEPROM_CALIBRATION_SIZE) // run recorder uses the rest of the EEPROM, see recorder.cpp
+#define EEPROM_RECORDER_END  ((uint8_t*)+E2END + 1)
 
+// all EEPROM writes go through a queue that the EEPROM ready interrupt works through, so they do not block
+void nvm_write(uint8_t* addr, const void* data, uint8_t size);
+uint8_t nvm_read_byte(const uint8_t* addr); // sees the writes that are still queued
+char nvm_busy();
+
+uint16_t nvm_runs();
+void nvm_count_run();
+
+// these load and save the selected profile
 void profile_load(profile_t* profile);
 void profile_save(profile_t* profile);
 
+uint8_t profile_selected();
+void profile_select(uint8_t slot);
+char profile_slot_valid(uint8_t slot);
+void profile_name(uint8_t slot, char* name); // name needs room for PROFILE_NAME_SIZE + 1 characters
+void profile_rename(uint8_t slot, const char* name);
+
 void settings_load(settings_t* s);
 void settings_save(settings_t* s);
 
+void calibration_load(calibration_t* cal);
+void calibration_save(calibration_t* cal);
+
 #endif
\ No newline at end of file
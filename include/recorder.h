@@ -0,0 +1,29 @@
+#ifndef recorder_h
+#define recorder_h
+
+#include <stdint.h>
+#include "reflowtoasteroven.h" // for RUN_RECORDER
+
+#define REC_MAGIC 0x58	 // marks a recording in EEPROM, changes with the layout
+#define REC_INTERVAL 2	 // record every 2nd temperature check, so about once a second
+#define REC_STAGES (PROFILE_SEGMENTS + 1) // a stage per segment and the last one is done
+#define REC_ESCAPE 0x8	 // nibble that is followed by 3 nibbles holding the absolute value
+#define REC_END 0xFFF	 // absolute value that marks the end of the recording
+#define REC_SCALE 5		 // values are in 0.5 C, 0.1 C would only fit 12 bits up to 409.5 C
+
+#if RUN_RECORDER
+
+void rec_start();
+void rec_sample(char stage, int16_t temp, int16_t setpoint);
+void rec_stop();
+void rec_dump();
+
+#else
+
+static inline void rec_start() {}
+static inline void rec_sample(char stage, int16_t temp, int16_t setpoint) {}
+static inline void rec_stop() {}
+
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef reflowcontrol_h
+#define reflowcontrol_h
+
+#include <stdint.h>
+#include "reflowtoasteroven.h" // for profile_t
+
+#define REFLOW_STAGE_DONE PROFILE_SEGMENTS // the stage is the segment that runs, this one comes after the last
+#define PREDICTOR_MAX_DELAY 64 // temperature checks, about 33 s
+
+// Smith predictor, a first order model of the toaster in fixed point, see reflowcontrol.cpp
+typedef struct
+{
+	int32_t model;						   // model temperature without dead time, 0.1 C << 12
+	uint16_t history[PREDICTOR_MAX_DELAY]; // earlier model temperatures, 0.1 C << 3
+	uint8_t idx;						   // oldest entry in history
+	uint8_t delay;						   // dead time in temperature checks
+	uint16_t alpha;						   // part of the way to the steady temperature covered per check, << 16
+	uint16_t room;						   // steady temperature at 0% duty cycle, 0.1 C << 3
+	uint16_t gain;						   // steady temperature rise at 100% duty cycle, 0.1 C << 3
+} predictor_t;
+
+// estimate of the reading and its rate, see reflowcontrol.cpp
+typedef struct
+{
+	int32_t temp;		 // 0.1 C << 16
+	int32_t bias;		 // rate the model of the predictor does not explain, 0.1 C << 16 per check
+	int32_t rate;		 // 0.1 C << 16 per check
+	uint16_t model_last; // delayed model output at the last check, 0.1 C << 3
+} estimator_t;
+
+// a profile segment compiled for reflow_step(), setpoints in 0.1 C << 16
+typedef struct
+{
+	uint8_t type;
+	char predict;		 // runs on the prediction of the reading instead of the reading itself
+	uint16_t length;	 // checks, the segment ends after this many for ramp time and hold
+	int32_t start;		 // setpoint at the start, the ramp starts from the reading instead
+	int32_t end;		 // the setpoint stops here
+	int32_t until;		 // reading that ends ramp, wait and cool
+	int32_t step;		 // setpoint change per check
+	int32_t feedforward; // rate_pwm() of the step
+} reflow_segment_t;
+
+// state of the reflow state machine, one temperature check at a time
+// this does not touch any hardware, so it can also be run on a PC against a recorded trace (see tools/replay)
+typedef struct
+{
+	char stage;			 // the segment that runs, REFLOW_STAGE_DONE after the last one
+	uint32_t total_cnt;	 // counter for the entire process
+	uint16_t length_cnt; // counter for a particular stage
+	uint16_t pwm_ocr;	 // PWM duty cycle for the heating element
+	int16_t tgt_temp;	 // target temperature, 0.1 C
+	int32_t setpoint;	 // target temperature, 0.1 C << 16
+	int32_t step;		 // setpoint change per check, 0 once the segment has reached its end
+	int32_t ramp_ff;	 // rate_pwm() of step
+	reflow_segment_t table[PROFILE_SEGMENTS];
+	int32_t integral;
+	int16_t last_error;
+	char transfer;		 // the next PID call continues the correction of the previous stage (BUMPLESS_TRANSFER)
+	int32_t feedforward; // approx_pwm() and rate feedforward of the last PID call
+	predictor_t pred;
+	estimator_t est;
+} reflow_t;
+
+int32_t approx_pwm(int16_t target);
+double rate_pwm(double rate);
+double profile_duration(profile_t *profile, double max_heat_rate);
+void reflow_init(reflow_t *r, profile_t *profile, int16_t cur_temp);
+void reflow_step(reflow_t *r, int16_t cur_temp);
+
+#endif
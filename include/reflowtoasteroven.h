@@ -29,34 +29,106 @@
 #define reflowtoasteroven_h
 
 #include <stdio.h>
+#include <stdint.h>
 
-#define TMR_OVF_TIMESPAN 0.002048		// timespan (in seconds) between consecutive timer overflow events
+#define TMR_OVF_US 2048					// microseconds between consecutive timer overflow events, the heater PWM step, Timer1 derives its count from F_CPU
+#define TMR_OVF_TIMESPAN (TMR_OVF_US / 1000000.0) // the same in seconds
+#define LOG_BAUD 9600					// of the serial port, log and commands
 //#define THERMOCOUPLE_CONSTANT 0.32  	// For 3v3 suply/adcref  this is derived from the AD595AQ datasheet - 10 mV/C and 3.3V/1023 = 0,0032V/ADC tick = 3.2mV ^ 0,32 C
-#define THERMOCOUPLE_CONSTANT 0.48876 	// For 5V supply/ ADCref this is derived from the AD595AQ datasheet - 10 mV/C and 5V/1023 = 0,00489V/ADC tick = 4.9mV ^ 0,489 C
+#define THERMOCOUPLE_CONSTANT 0.48876 	// AD595 only, For 5V supply/ ADCref this is derived from the AD595AQ datasheet - 10 mV/C and 5V/1023 = 0,00489V/ADC tick = 4.9mV ^ 0,489 C
 #define ROOM_TEMP 20.0
+#ifndef BOARD
+#define BOARD BOARD_OVEN 				// the pins and the clock, see board.h
+#endif
+#ifndef TEMP_SENSOR
+#define TEMP_SENSOR sensor_ad595 		// the thermocouple converter: sensor_ad595, or sensor_max31855 or sensor_max6675 on SPI with CS on pin_tc_cs, see temperaturemeasurement.h
+#endif
 #define TEMP_MEASURE_CHAN 0 			// the ADC pin connected to the AD595AQ
+#define TEMP_AIR_CHAN 1 				// the ADC pin of the AD595AQ of the second thermocouple, the second SPI converter has CS on PB1
+#ifndef SENSOR_CHANNELS
+#define SENSOR_CHANNELS 1 				// thermocouples, 1 or 2: the first one on the board, the second one in the air, logged after the other CSV columns
+#endif
+#ifndef SENSOR_MIX
+#define SENSOR_MIX 0.0 					// with 2 thermocouples, the share of the air one in what the control works on, 0 to 1, or SENSOR_MIX_MAX for the hotter one
+#endif
+#define SENSOR_MIX_MAX -1.0
 #define DEMO_MODE 0 					// 1 means the current temperature reading will always be overwritten to match the target temperature, note that PWM output is still active even if in DEMO mode
 #define ROTENC_PPS 4 					// 4 pulses per step, so divide read value by 4
+#ifndef SERIAL_COMMANDS
+#define SERIAL_COMMANDS 1 				// 1 means settings and profile can be read/written and modes started over the serial port, see serialcmd.cpp
+#endif
+#ifndef RUN_RECORDER
+#define RUN_RECORDER 1 					// 1 means the trace of the last automatic run is kept in EEPROM, see recorder.cpp
+#endif
+#ifndef PEAK_PREDICTOR
+#define PEAK_PREDICTOR 1 				// 1 means the reflow and peak stages act on a prediction of the temperature, which stops overshoot, see reflowcontrol.cpp
+#endif
+#ifndef OVEN_DEAD_TIME
+#define OVEN_DEAD_TIME 10.0 			// seconds before a change of the heating shows at the thermocouple, tools/ovenmodel.py suggests a value, too short is safer than too long
+#endif
+#ifndef RATE_ESTIMATOR
+#define RATE_ESTIMATOR 1 				// 1 means the profile controller works on a filtered reading and its estimated rate, see reflowcontrol.cpp
+#endif
+#ifndef BUMPLESS_TRANSFER
+#define BUMPLESS_TRANSFER 1 			// 1 means the PID correction continues where it was at stage changes instead of restarting without integral, see reflowcontrol.cpp
+#endif
+#ifndef AUTOTUNE
+#define AUTOTUNE 1 						// 1 means the main menu has a relay feedback PID autotune mode, see autotune.cpp
+#endif
+#ifndef STACK_MONITOR
+#define STACK_MONITOR 1 				// 1 means the free RAM is painted at reset so the serial command "mem" can tell how deep the stack has been, see meminfo.cpp
+#endif
+#ifndef BENCHMARK
+#define BENCHMARK 0 					// 1 means the firmware prints cycle counts of the hot paths instead of running the oven, see bench.cpp and [env:bench]
+#endif
 
 
+#define PROFILE_SEGMENTS 8				// most segments a profile can have
+#define SEGMENT_TEMP_MAX 3500			// 0.1 C, the hottest a segment can go to
+
+// segment types, value is in the unit segment_value() returns, see reflowcontrol.cpp for how they run
+#define SEGMENT_END 0					// unused, the profile ends at the first of these
+#define SEGMENT_RAMP 1					// ramp from the reading to temp at value C/s, until the reading gets there
+#define SEGMENT_RAMP_TIME 2				// ramp from the temp of the previous segment to temp in value seconds
+#define SEGMENT_HOLD 3					// stay at temp for value seconds
+#define SEGMENT_WAIT 4					// aim value C past temp until the reading gets to temp
+#define SEGMENT_COOL 5					// ramp down at value C/s, until the reading gets below temp
+#define SEGMENT_TYPES 6
+
+// packed, the AVR has no padding anyway, so a profile is the same 40 bytes in EEPROM when built for the PC
+typedef struct __attribute__((packed))
+{
+	uint8_t type;
+	int16_t temp;	// 0.1 C
+	uint16_t value; // 0.01 C/s for ramp and cool, seconds for ramp time and hold, 0.1 C for wait
+} segment_t;
+
 typedef struct
 {
-	double start_rate;
-	double soak_temp1;
-	double soak_temp2;
-	uint16_t soak_length;
-	double peak_temp;
-	uint16_t time_to_peak;
-	double cool_rate;
+	segment_t seg[PROFILE_SEGMENTS];
 } profile_t;
 
+// pid() works with the gains in 1/256 steps, see reflowcontrol.cpp
+#define GAIN_SHIFT 8
+#define GAIN_STEP (1.0 / (1 << GAIN_SHIFT))
+#define GAIN_MAX (1L << 18)					  // in steps, so a gain times an error fits 32 bits with room to spare
+#define GAIN_LIMIT (GAIN_MAX >> GAIN_SHIFT) // 1024, the largest gain settings_valid() accepts
+#define GAIN_DECIMALS 3						  // enough to tell every step apart
+
+// float is what double is on the AVR, it keeps the record in EEPROM the same when built for the PC, see test/
 typedef struct
 {
-	double pid_p;
-	double pid_i;
-	double pid_d;
-	double max_temp;
-	double time_to_max;
+	float pid_p; // PWM per 0.1 C of error, see pid()
+	float pid_i;
+	float pid_d;
+	float max_temp;
+	float time_to_max;
+	// gain schedule, pid_p/i/d apply up to sched_low and the hot gains from sched_high on, blended in between
+	float pid_p_hot;
+	float pid_i_hot;
+	float pid_d_hot;
+	float sched_low;
+	float sched_high;
 } settings_t;
 
 extern settings_t settings;
@@ -66,17 +138,26 @@ extern volatile char tmr_checktemp_flag;
 extern volatile char tmr_drawlcd_flag;
 
 void profile_setdefault(profile_t* profile);
+void profile_stages(profile_t* profile, double start_rate, double soak_temp1, double soak_temp2, uint16_t soak_length, double peak_temp, uint16_t time_to_peak, double cool_rate);
+double segment_value(segment_t* seg);
+void segment_set(segment_t* seg, uint8_t type, double temp, double value);
 void settings_setdefault(settings_t* s);
 char profile_valid(profile_t* profile);
 char settings_valid(settings_t* s);
 void auto_go(profile_t* profile);
 char* str_from_int(signed long value);
 char* str_from_double(double value, int decimalplaces);
-uint16_t pid(double target, double current, double * integral, double * last_error);
+char* str_from_deci(int32_t value);
+char* str_from_fixed(int32_t value, uint8_t decimals);
+void pid_init();
+uint16_t pid(int16_t target, int16_t current, int32_t * integral, int16_t * last_error, int32_t feedforward);
+void pid_track(int16_t target, int16_t current, int32_t * integral, int16_t * last_error, int32_t feedback);
 
 //min and max are already defined in arduino.h...
 //#define min(x,y) (((x) < (y)) ? (x) : (y))
 //#define max(x,y) (((x) > (y)) ? (x) : (y))
-#define sensor_to_temperature(x) ((x)*THERMOCOUPLE_CONSTANT)
+// temperatures are int16_t in 0.1 C everywhere, the same unit as segment_t.temp, doubles in C only in the settings
+#define deci_to_temperature(x) ((x) / 10.0)
+#define temperature_to_deci(x) ((int16_t)((x) * 10.0 + ((x) < 0 ? -0.5 : 0.5)))
 
 #endif
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef serialcmd_h
+#define serialcmd_h
+
+#include "reflowtoasteroven.h" // for SERIAL_COMMANDS
+
+// actions requested over the serial port, these are handled by whichever menu loop is active
+#define CMD_NONE 0
+#define CMD_START 1 // run the stored profile
+#define CMD_ABORT 2 // turn off and leave the current mode
+#define CMD_TEMP 3	// manual temperature control, setpoint in cmd_arg
+#define CMD_PWM 4	// manual PWM control, duty cycle in cmd_arg
+
+#if SERIAL_COMMANDS
+
+extern double cmd_arg;
+extern char cmd_telemetry;
+
+char cmd_poll();	 // read and execute received lines, returns the pending action (CMD_NONE if there is none)
+void cmd_accept(); // pending action has been carried out, acknowledge it
+void cmd_reject(); // pending action can not be carried out right now
+void cmd_run(char running); // while a run is going on, commands that write to EEPROM are refused
+
+#else
+
+#define cmd_arg 0.0
+#define cmd_telemetry 1
+static inline char cmd_poll() { return CMD_NONE; }
+static inline void cmd_accept() {}
+static inline void cmd_reject() {}
+static inline void cmd_run(char running) {}
+
+#endif
+
+#endif
@@ -28,11 +28,48 @@
 #ifndef temperaturemeasurement_h
 #define temperaturemeasurement_h
 
-void adc_init();
-uint16_t sensor_read();
-uint16_t temperature_to_sensor(double);
-uint16_t temperature_to_sensor(float);
-uint16_t temperature_to_sensor(int);
+#include <stdint.h>
+
+// fault bits, what sensor_fault() and the drivers' fault() return
+#define SENSOR_OPEN 0x01		// thermocouple not connected
+#define SENSOR_SHORT_GND 0x02	// thermocouple shorted to ground
+#define SENSOR_SHORT_VCC 0x04	// thermocouple shorted to the supply
+#define SENSOR_NO_DEVICE 0x08	// nothing answers
+
+#define CALIBRATION_POINTS 6
+#define CALIBRATION_MAX 6000 // 0.1 C, the points lie from 0 to this
+
+// maps what the converter reads to what the temperature is, between the points in straight lines
+typedef struct
+{
+	int16_t offset;					 // 0.1 C, added to every reading after the points
+	int16_t raw[CALIBRATION_POINTS];  // 0.1 C as the converter reads it, rising
+	int16_t temp[CALIBRATION_POINTS]; // 0.1 C it really is at that reading, rising
+} calibration_t;
+
+// a thermocouple converter, TEMP_SENSOR in reflowtoasteroven.h says which one is fitted
+typedef struct
+{
+	void (*init)();
+	void (*start)();	// (re)starts measuring, forgets earlier readings
+	char (*poll)();					// 1 if there are new readings of all channels, called at every temperature check
+	int32_t (*read)(uint8_t channel);	// the newest reading in 0.01 C
+	uint8_t (*fault)(uint8_t channel); // SENSOR_* bits of the newest reading, 0 if it is good
+	const calibration_t* calibration;	// the default, in flash
+} sensor_driver_t;
+
+extern const sensor_driver_t sensor_ad595;	 // AD595AQ on the ADC, see temperaturemeasurement.cpp
+extern const sensor_driver_t sensor_max31855; // on SPI, see max31855.cpp
+extern const sensor_driver_t sensor_max6675;
+extern const calibration_t calibration_none; // for converters that linearize themselves
+
+void sensor_init();
+int16_t sensor_read(); // in 0.1 C, combined as SENSOR_MIX says
+int16_t sensor_read_channel(uint8_t channel); // what the last sensor_read() got from one thermocouple
+uint8_t sensor_fault(); // the fault bits of all channels
+void calibration_setdefault(calibration_t* cal);
+char calibration_valid(calibration_t* cal);
+void sensor_calibrate(calibration_t* cal); // from now on the readings go through cal
 void sensor_filter_reset();
 
 #endif
\ No newline at end of file
@@ -2,10 +2,11 @@
 #define userinput_h
 #include <Arduino.h>
 #include "Encoder.h"
+#include "board.h"
 
 extern Encoder RotEnc;
 void button_init();
 
-#define button_enter() bit_is_clear(PIND, 4)
+#define button_enter() pin_button::is_low()
 
 #endif
\ No newline at end of file
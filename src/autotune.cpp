@@ -0,0 +1,135 @@
+/* Relay feedback autotune (Astrom-Hagglund)
+ *
+ * The heater is switched between bias + amplitude and bias - amplitude whenever the temperature
+ * crosses the setpoint, which makes the oven oscillate around it. The period of that oscillation
+ * is the ultimate period Tu, and from its height the ultimate gain follows:
+ *   Ku = 4 * amplitude / (pi * sqrt(a^2 - hysteresis^2)), a being half the peak to peak height
+ * bias is what approx_pwm() expects to hold the setpoint, so the oscillation is about symmetric.
+ *
+ * Gains are Tyreus-Luyben PI, which overshoots less than Ziegler-Nichols on a slow oven. The
+ * derivative is left off, on the noise of the reading it only adds noise.
+ * Everything is in 0.1 C and temperature checks, the units pid() works in.
+ */
+
+#include <stdint.h>
+#include <math.h>
+
+#include "reflowtoasteroven.h"
+#include "temperaturemeasurement.h"
+#include "reflowcontrol.h" // approx_pwm
+#include "autotune.h"
+
+#if AUTOTUNE
+
+void autotune_init(autotune_t *t, double temp)
+{
+	t->state = AUTOTUNE_RUNNING;
+	t->high = 1; // heat up to the setpoint first
+	t->cycles = 0;
+	t->setpoint = temperature_to_deci(temp);
+	t->limit = temperature_to_deci(settings.max_temp);
+	t->tick = 0;
+	t->last_rise = 0;
+	t->top = 0;
+	t->bottom = 0;
+	t->period_sum = 0;
+	t->height_sum = 0;
+
+	pid_init(); // for approx_pwm()
+	int32_t bias = approx_pwm(t->setpoint);
+	t->bias = bias > 65535 ? 65535 : bias;
+	t->amplitude = t->bias < 32768 ? t->bias : 65535 - t->bias;
+	t->pwm_ocr = t->bias + t->amplitude;
+}
+
+void autotune_step(autotune_t *t, int16_t cur_temp)
+{
+	if (t->state != AUTOTUNE_RUNNING)
+	{
+		t->pwm_ocr = 0;
+		return;
+	}
+
+	t->tick++;
+	if (cur_temp > t->limit || t->tick > AUTOTUNE_TIMEOUT || t->amplitude == 0)
+	{
+		t->state = AUTOTUNE_FAILED;
+		t->pwm_ocr = 0;
+		return;
+	}
+
+	if (cur_temp > t->top)
+	{
+		t->top = cur_temp;
+	}
+	if (cur_temp < t->bottom)
+	{
+		t->bottom = cur_temp;
+	}
+
+	if (t->high && cur_temp > t->setpoint + AUTOTUNE_HYSTERESIS)
+	{
+		t->high = 0;
+	}
+	else if (!t->high && cur_temp < t->setpoint - AUTOTUNE_HYSTERESIS)
+	{
+		// rising edge, a full cycle has passed since the previous one
+		t->high = 1;
+		if (t->cycles >= AUTOTUNE_SKIP)
+		{
+			t->period_sum += t->tick - t->last_rise;
+			t->height_sum += t->top - t->bottom;
+		}
+		t->cycles++;
+		t->last_rise = t->tick;
+		t->top = cur_temp;
+		t->bottom = cur_temp;
+
+		if (t->cycles >= AUTOTUNE_SKIP + AUTOTUNE_CYCLES)
+		{
+			t->state = AUTOTUNE_DONE;
+			t->pwm_ocr = 0;
+			return;
+		}
+	}
+
+	t->pwm_ocr = t->high ? t->bias + t->amplitude : t->bias - t->amplitude;
+}
+
+// puts the PID gains in s, the hot ones if it was tuned at or above sched_high
+// returns 0 if the oscillation was too small to use, or the gains are out of range
+char autotune_result(autotune_t *t, settings_t *s)
+{
+	if (t->state != AUTOTUNE_DONE)
+	{
+		return 0;
+	}
+
+	double a = (double)t->height_sum / (2 * AUTOTUNE_CYCLES);
+	double tu = (double)t->period_sum / AUTOTUNE_CYCLES;
+	if (a <= AUTOTUNE_HYSTERESIS || tu <= 0)
+	{
+		return 0;
+	}
+	double ku = 4.0 * t->amplitude / (M_PI * sqrt(a * a - AUTOTUNE_HYSTERESIS * AUTOTUNE_HYSTERESIS));
+
+	double p = ku / 3.2;
+	double i = p / (2.2 * tu); // pid() adds the error once per temperature check
+
+	// tuned in the hot part of the gain schedule, or the normal part
+	if (t->setpoint >= temperature_to_deci(s->sched_high))
+	{
+		s->pid_p_hot = p;
+		s->pid_i_hot = i;
+		s->pid_d_hot = 0.0;
+	}
+	else
+	{
+		s->pid_p = p;
+		s->pid_i = i;
+		s->pid_d = 0.0;
+	}
+	return settings_valid(s);
+}
+
+#endif
@@ -0,0 +1,224 @@
+/* Cycle counts of the hot paths
+ *
+ * Built by [env:bench] in platformio.ini (BENCHMARK 1). Instead of the menu, main() calls bench_run(),
+ * which times each path with Timer1 running at the CPU clock and prints a line per path:
+ *
+ *   bench, <name>, <fewest cycles>, <most cycles>,
+ *
+ * per call, with the cost of reading the timer taken off. tools/bench/bench.py runs it on simavr and
+ * compares the most cycles with tools/bench/limits.ini, the numbers are the same on the real oven.
+ *
+ * The other interrupts are stopped while timing (millis, the ADC, serial output is flushed first), only
+ * the Timer1 overflow every 65536 cycles is left, which adds a few cycles to the display frame.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <stdint.h>
+
+#include <Arduino.h>
+#include <TimerOne.h>
+#include "lcd.h"
+
+#include "reflowtoasteroven.h"
+#include "temperaturemeasurement.h"
+#include "heatingelement.h"
+#include "reflowcontrol.h"
+#include "menu.h"
+#include "bench.h"
+
+#if BENCHMARK
+
+#define BENCH_RUNS 16
+
+extern "C" void ADC_vect(void) __attribute__((signal)); // in temperaturemeasurement.cpp, called directly here
+extern uint8_t temp_history[LCD_WIDTH];
+
+static volatile uint16_t bench_overflows;
+static uint32_t bench_start;
+static uint32_t bench_overhead;
+static uint32_t bench_fewest;
+static uint32_t bench_most;
+
+static void bench_overflow()
+{
+	bench_overflows++;
+}
+
+// CPU cycles since bench_run() started the timer
+static uint32_t bench_cycles()
+{
+	uint8_t sreg = SREG;
+	cli();
+	uint16_t low = TCNT1;
+	uint16_t high = bench_overflows;
+	if ((TIFR1 & _BV(TOV1)) && low < 0x8000)
+	{
+		high++; // overflowed just now, the interrupt is still pending
+	}
+	SREG = sreg;
+	return ((uint32_t)high << 16) | low;
+}
+
+static void bench_begin()
+{
+	bench_fewest = UINT32_MAX;
+	bench_most = 0;
+}
+
+static inline void bench_in()
+{
+	bench_start = bench_cycles();
+}
+
+static inline void bench_out()
+{
+	uint32_t cycles = bench_cycles() - bench_start - bench_overhead;
+	if (cycles < bench_fewest)
+	{
+		bench_fewest = cycles;
+	}
+	if (cycles > bench_most)
+	{
+		bench_most = cycles;
+	}
+}
+
+static void bench_end(PGM_P name)
+{
+	fprintf_P(&log_stream, PSTR("bench, %S, %lu, %lu,\n"), name, bench_fewest, bench_most);
+	Serial.flush(); // the transmit interrupt would count towards the next one
+}
+
+void bench_run()
+{
+	uint8_t i;
+
+	fprintf_P(&log_stream, PSTR("bench start, %lu,\n"), (uint32_t)F_CPU); // cycles per second
+	Serial.flush();
+
+	ADCSRA = 0;	// no conversions, the samples come from the calls to ADC_vect below
+	TIMSK0 = 0; // no millis, which would interrupt every 1024 us
+	TCCR1A = 0;
+	TCCR1B = _BV(CS10); // normal mode at the CPU clock
+	TCNT1 = 0;
+	Timer1.attachInterrupt(bench_overflow);
+
+	bench_begin();
+	for (i = 0; i < BENCH_RUNS; i++)
+	{
+		bench_in();
+		bench_out();
+	}
+	bench_overhead = bench_fewest;
+	bench_end(PSTR("overhead"));
+
+	// fills every sample, whatever the ADC pins read on the simulator, with the interrupt entry and exit
+	bench_begin();
+	for (uint16_t n = 0; n < 128; n++)
+	{
+		bench_in();
+		ADC_vect();
+		bench_out();
+		ADCSRA = 0; // it started the next conversion
+	}
+	bench_end(PSTR("ADC_vect"));
+
+	bench_begin();
+	for (i = 0; i < BENCH_RUNS; i++)
+	{
+		bench_in();
+		sensor_read();
+		bench_out();
+	}
+	bench_end(PSTR("sensor_read"));
+
+	settings_setdefault(&settings);
+	pid_init();
+	{
+		int32_t integral = 0;
+		int16_t last_error = 0;
+		bench_begin();
+		for (i = 0; i < BENCH_RUNS; i++)
+		{
+			int16_t current = 1400 + i * 16; // errors of both signs, from 10 C below the target up
+			bench_in();
+			pid(1500, current, &integral, &last_error, 0);
+			bench_out();
+		}
+		bench_end(PSTR("pid"));
+	}
+
+	{
+		profile_t profile;
+		reflow_t r;
+		profile_setdefault(&profile);
+		reflow_init(&r, &profile, 200);
+		bench_begin();
+		for (i = 0; i < BENCH_RUNS; i++)
+		{
+			bench_in();
+			reflow_step(&r, 200 + i * 5);
+			bench_out();
+		}
+		bench_end(PSTR("reflow_step"));
+
+		heat_set(32768);
+		bench_begin();
+		for (uint16_t n = 0; n < 512; n++) // a whole PWM period, the first call of it does the most
+		{
+			bench_in();
+			heat_isr();
+			bench_out();
+		}
+		heat_set(0);
+		bench_end(PSTR("heat_isr"));
+
+		bench_begin();
+		for (i = 0; i < BENCH_RUNS; i++)
+		{
+			bench_in();
+			str_from_double(217.5 + i, 1);
+			bench_out();
+		}
+		bench_end(PSTR("str_from_double"));
+
+		bench_begin();
+		for (i = 0; i < BENCH_RUNS; i++)
+		{
+			bench_in();
+			str_from_deci(2175 + i * 10);
+			bench_out();
+		}
+		bench_end(PSTR("str_from_deci"));
+
+		for (i = 0; i < LCD_WIDTH; i++)
+		{
+			temp_history[i] = i / 3; // a ramp across the screen
+		}
+		bench_begin();
+		for (i = 0; i < 2; i++)
+		{
+			bench_in();
+			auto_draw(&r, 2175);
+			bench_out();
+		}
+		bench_end(PSTR("auto_draw"));
+	}
+
+	fprintf_P(&log_stream, PSTR("bench done,\n"));
+	Serial.flush();
+
+	// simavr quits when the CPU sleeps with the interrupts off
+	set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+	cli();
+	sleep_enable();
+	sleep_cpu();
+	while (1)
+	{
+	}
+}
+
+#endif
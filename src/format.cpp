@@ -0,0 +1,64 @@
+/* Number formatting
+ *
+ * The text of the numbers on the display, in the log and in the serial replies. Decimals go through
+ * str_from_fixed(), integer only, so no float to text conversion (dtostrf, printf %f) is linked. Kept apart
+ * from the menus so it builds without the display, see [env:native].
+ *
+ * The functions return the same buffer, which the next call overwrites.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "reflowtoasteroven.h"
+
+static char strbuf[24]; // a line of the display, and more than any int32_t with its sign and point
+
+char *str_from_int(signed long value)
+{
+	return ltoa(value, strbuf, 10);
+}
+
+// a fixed point value, value / 10^decimals, formatted without doubles
+char *str_from_fixed(int32_t value, uint8_t decimals)
+{
+	char *digits = strbuf;
+	if (value < 0)
+	{
+		*digits++ = '-';
+	}
+	ultoa(value < 0 ? -(uint32_t)value : value, digits, 10);
+	uint8_t len = strlen(digits);
+	if (decimals > 0)
+	{
+		if (len <= decimals)
+		{
+			// zeros in front, so there is a digit before the point
+			memmove(digits + decimals + 1 - len, digits, len + 1);
+			memset(digits, '0', decimals + 1 - len);
+			len = decimals + 1;
+		}
+		memmove(digits + len - decimals + 1, digits + len - decimals, decimals + 1);
+		digits[len - decimals] = '.';
+	}
+	return strbuf;
+}
+
+// a value in tenths, like a temperature in 0.1 C, with one decimal
+char *str_from_deci(int32_t value)
+{
+	return str_from_fixed(value, 1);
+}
+
+// rounded to a fixed point value first, so dtostrf and its float formatting are not needed
+char *str_from_double(double value, int decimalplaces)
+{
+	int32_t scale = 1;
+	for (int i = 0; i < decimalplaces; i++)
+	{
+		scale *= 10;
+	}
+	return str_from_fixed(lround(value * scale), decimalplaces);
+}
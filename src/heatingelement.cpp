@@ -28,19 +28,20 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "heatingelement.h"
+#include "board.h"
 
 void heat_init()
 {
 	// initialize the SSR control pin as output
-	PWM_DDRx |= _BV(PWM_PIN);
-	PWM_PORTx &= ~_BV(PWM_PIN);
+	pin_heater::output();
+	pin_heater::clear();
 }
 
 volatile uint16_t pwm_ocr = 0;
 volatile uint16_t pwm_ocr_temp = 0;
 volatile uint16_t heat_isr_cnt = 0;
 
-// this function needs to be called during the timer overflow interrupt of a 8-bit timer running at 8MHz/64 -- so OVF at 8M/64/256 = 490.19 Hz, so PWM at 490.2/512 = 0.96 Hz
+// this function needs to be called during the timer overflow interrupt, every TMR_OVF_US = 2048 us, so 488.3 Hz at any clock -- so PWM at 488.3/512 = 0.95 Hz
 void heat_isr() 
 {
 	if (heat_isr_cnt == 511)
@@ -49,18 +50,18 @@ void heat_isr()
 		pwm_ocr = pwm_ocr_temp;
 		if (pwm_ocr > 0)
 		{
-			PWM_PORTx |= _BV(PWM_PIN);
+			pin_heater::set();
 		}
 		else
 		{
-			PWM_PORTx &= ~_BV(PWM_PIN);
+			pin_heater::clear();
 		}
 	}
 	else
 	{
 		if (pwm_ocr <= heat_isr_cnt)
 		{
-			PWM_PORTx &= ~_BV(PWM_PIN);
+			pin_heater::clear();
 		}
 		
 		heat_isr_cnt++;
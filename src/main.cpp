@@ -25,8 +25,6 @@
  *
  */
 
-#define F_CPU 8000000UL // 8 MHz internal oscilator
-
 #include <avr/power.h>
 #include <avr/wdt.h>
 #include <avr/io.h>
@@ -48,13 +46,30 @@
 #include "temperaturemeasurement.h"
 #include "heatingelement.h"
 #include "menu.h"
+#include "serialcmd.h"
+#include "recorder.h"
+#include "reflowcontrol.h"
+#include "bench.h"
+#include "board.h"
 
 settings_t settings;					 // store this globally so it's easy to access
-U8GLIB_ST7920_128X64_1X u8g(A3, A5, A4); // SPI Com: SCK = en = LCD4 = PC3 = A3, MOSI = rw = SID = LCDE = PC5 = A5, CS = di = RS =LCDRS =PC4 = A4
+U8GLIB_ST7920_128X64_1X u8g(pin_lcd_sck::arduino, pin_lcd_mosi::arduino, pin_lcd_cs::arduino); // SPI Com: SCK = en = LCD4, MOSI = rw = SID = LCDE, CS = di = RS = LCDRS, see board.h
 FILE log_stream;						 // different in cpp from c = FDEV_SETUP_STREAM(log_putchar_stream, NULL, _FDEV_SETUP_WRITE);
 
 static int log_putchar_stream(char c, FILE *stream);
 
+// the clock is board_build.f_cpu, checked against the BOARD in board.h, these have to work out at any of them
+static_assert((uint64_t)F_CPU * TMR_OVF_US % 2000000 == 0, "Timer1 (phase correct, no prescaler) can not count TMR_OVF_US in whole cycles at this F_CPU");
+#define LOG_UBRR ((F_CPU / 4 / LOG_BAUD - 1) / 2) // the divisor the Arduino core picks, with U2X
+static_assert(F_CPU / (8 * (LOG_UBRR + 1)) * 100 >= LOG_BAUD * 98UL && F_CPU / (8 * (LOG_UBRR + 1)) * 100 <= LOG_BAUD * 102UL,
+			  "LOG_BAUD is more than 2 % off at this F_CPU");
+
+// the log time in 0.1 s is total_cnt * TMR_OVF_US * 256 / 100000, with the fraction reduced so the product fits 32 bits
+constexpr uint32_t log_gcd(uint32_t a, uint32_t b) { return b == 0 ? a : log_gcd(b, a % b); }
+constexpr uint32_t LOG_TIME_NUM = (uint32_t)TMR_OVF_US * 256 / log_gcd((uint32_t)TMR_OVF_US * 256, 100000);
+constexpr uint32_t LOG_TIME_DEN = 100000 / log_gcd((uint32_t)TMR_OVF_US * 256, 100000);
+static_assert(LOG_TIME_NUM < 65536, "the log time of a run of 65536 temperature checks does not fit 32 bits");
+
 int main()
 {
 	fdev_setup_stream(&log_stream, log_putchar_stream, NULL, _FDEV_SETUP_WRITE);
@@ -63,25 +78,35 @@ int main()
 	init(); // init function from arduino. Sets up ADC and timers etc. for their default arduino-usage
 	// that means the reflow oven can't use a timer interrupt for PWM, like Frank Zhao originaly did.
 
-	Serial.begin(9600); // output stream / log / debug
+	Serial.begin(LOG_BAUD); // output stream / log / debug
 
 	fprintf_P(&log_stream, PSTR("hello world,\n"));
 
 	button_init();
+	settings_load(&settings); // load from eeprom, so the serial commands can check against it
 
 	u8g.begin();
 	u8g.setFont(u8g_font_unifont);
-	adc_init();
+	sensor_init();
+	{
+		calibration_t cal;
+		calibration_load(&cal); // from eeprom, or the defaults of the sensor
+		sensor_calibrate(&cal);
+	}
+
+#if BENCHMARK
+	bench_run(); // takes Timer1 for itself and does not return
+#endif
 
 	heat_init();
-	Timer1.initialize(TMR_OVF_TIMESPAN * 1000000); // microseconds of timer period... So for 490 Hz, about 2048 (TIMER_OVF_TIMESPAN is the same thing, but in seconds)
+	Timer1.initialize(TMR_OVF_US); // microseconds of timer period, so about 490 Hz
 	Timer1.attachInterrupt(heat_isr);
 	Timer1.start();
 
 	fprintf_P(&log_stream, PSTR("reflow toaster oven,\n"));
 
 	// DDRD|=(1<<PORTD7); // set PD7 output for debugLED -- no, is connected to (unused) sd card detect switch
-	DDRD |= _BV(5); // PORTD.5 output for buzzer
+	pin_buzzer::output();
 
 	// initialization has finished here
 
@@ -90,54 +115,6 @@ int main()
 	return 0;
 }
 
-// this estimates the PWM duty cycle needed to reach a certain steady temperature
-// if the toaster is capable of a maximum of 300 degrees, then 100% duty cycle is used if the target temperature is 300 degrees, and 0% duty cycle is used if the target temperature is room temperature.
-double approx_pwm(double target)
-{
-	return 65535.0 * ((target * THERMOCOUPLE_CONSTANT) / settings.max_temp);
-}
-
-uint16_t pid(double target, double current, double *integral, double *last_error)
-{
-	double error;
-	if (target == 0)
-	{
-		// turn off if target temperature is 0
-
-		(*integral) = 0;
-		(*last_error) = error;
-		return 0;
-	}
-	else
-	{
-		if (target < 0)
-		{
-			target = 0;
-		}
-
-		error = target - current; // calculate this after limiting target to 0 or above... else oven switches ON once cooling has a setpoint below 0.
-
-		// calculate PID terms
-
-		double p_term = settings.pid_p * error;
-		double new_integral = (*integral) + error;
-		double d_term = ((*last_error) - error) * settings.pid_d;
-		(*last_error) = error;
-		double i_term = new_integral * settings.pid_i;
-
-		double result = approx_pwm(target) + p_term + i_term + d_term;
-
-		// limit the integral so it doesn't get out of control
-		if ((result >= 65535.0 && new_integral < (*integral)) || (result < 0.0 && new_integral > (*integral)) || (result <= 65535.0 && result >= 0))
-		{
-			(*integral) = new_integral;
-		}
-
-		// limit the range and return the rounded result for use as the PWM OCR value
-		return (uint16_t)lround(result > 65535.0 ? 65535.0 : (result < 0.0 ? 0.0 : result));
-	}
-}
-
 volatile uint16_t tmr_ovf_cnt = 0;
 volatile char tmr_checktemp_flag = 0;
 volatile char tmr_drawlcd_flag = 0;
@@ -148,6 +125,49 @@ uint8_t temp_history[LCD_WIDTH];
 uint16_t temp_history_idx;
 uint8_t temp_plan[LCD_WIDTH]; // also store the target temperature for comparison purposes
 
+// one frame of the auto mode screen: the graph with the current temperature, target temperature, and phase of reflow
+void auto_draw(reflow_t *r, int16_t cur_temp)
+{
+	u8g.firstPage();
+	do
+	{
+		u8g.drawStr(38, 14, "\xb0"
+							"C"); // 0xb0 is the degree sign in the unifont table
+		u8g.drawStr(25, 29, "\xb0"
+							"C set");
+		u8g.drawStr(0, 14, str_from_deci(cur_temp));
+		u8g.setPrintPos(0, 29);
+		u8g.print((r->tgt_temp + 5) / 10, DEC);
+		if (r->stage == REFLOW_STAGE_DONE)
+		{
+			u8g.drawStr(0, 44, "Done");
+		}
+		else
+		{
+			// segment number and type
+			u8g.setPrintPos(0, 44);
+			u8g.print(r->stage + 1, DEC);
+			u8g.drawStr(16, 44, segment_name(r->table[(uint8_t)r->stage].type));
+		}
+		if (DEMO_MODE)
+		{
+			u8g.drawStr(0, 60, "DEMO");
+		}
+		if (sensor_fault())
+		{
+			u8g.drawStr(0, 60, "Sensor fault"); // reads as full scale, so it does not heat
+		}
+
+		// always draw graph, otherwise it gets erased next display refresh
+		for (unsigned char x = 0; x < LCD_WIDTH; x++)
+		{
+			u8g.drawPixel(x, LCD_HEIGHT - temp_history[x]);
+			// graph scaling is done when saving the values
+		};
+
+	} while (u8g.nextPage());
+}
+
 // this function runs an entire reflow soldering profile
 // it works like a state machine
 void auto_go(profile_t *profile)
@@ -173,6 +193,8 @@ void auto_go(profile_t *profile)
 	}
 
 	fprintf_P(&log_stream, PSTR("auto mode session start,\n"));
+	rec_start();
+	nvm_count_run();
 
 	// this will be used for many things later
 	double max_heat_rate = settings.max_temp / settings.time_to_max;
@@ -188,24 +210,38 @@ void auto_go(profile_t *profile)
 	// total duration is calculated so we know how big the graph needs to span
 	// note, this calculation is only an worst case estimate
 	// it is also aware of whether or not the heating rate can be achieved
-	double total_duration = (double)(profile->soak_length + profile->time_to_peak) +
-							((profile->soak_temp1 - ROOM_TEMP) / min(profile->start_rate, max_heat_rate)) +
-							((profile->peak_temp - ROOM_TEMP) / profile->cool_rate) +
-							10.0; // some extra just in case
-	double graph_tick = total_duration / LCD_WIDTH;
-	double graph_timer = 0.0;
+	double total_duration = profile_duration(profile, max_heat_rate) + 10.0; // some extra just in case
+	uint32_t graph_tick = lround(total_duration / LCD_WIDTH / (TMR_OVF_TIMESPAN * 256) * 256); // in 1/256 temperature checks
+	uint32_t graph_timer = 0;
+
+	// the graph is scaled to max_temp and shifted down a bit to get more room
+	int16_t graph_max = temperature_to_deci(settings.max_temp);
+	int16_t graph_shiftdown = (temperature_to_deci(ROOM_TEMP * 1.25) * LCD_HEIGHT + graph_max / 2) / graph_max;
 
 	// some more variable initialization
-	double integral = 0.0, last_error = 0.0;
-	char stage = 0;			 // the state machine state
-	uint32_t total_cnt = 0;	 // counter for the entire process
-	uint16_t length_cnt = 0; // counter for a particular stage
-	uint16_t pwm_ocr = 0;	 // temporary holder for PWM duty cycle
-	double tgt_temp = sensor_to_temperature(sensor_read());
-	double start_temp = tgt_temp;
-	uint16_t cur_sensor = sensor_read();
+	static reflow_t r; // the state machine, see reflowcontrol.cpp, static because it is about 380 bytes and the stack of a run is deep already
+	int16_t cur_temp = sensor_read();
+	reflow_init(&r, profile, cur_temp);
+	cmd_run(1); // settings and profiles can not be changed over the serial port until the run ends
 	while (1)
 	{
+		// remote control, only aborting is possible while a profile is running
+		switch (cmd_poll())
+		{
+		case CMD_NONE:
+			break;
+		case CMD_ABORT:
+			heat_set(0);
+			rec_stop();
+			cmd_run(0);
+			cmd_accept();
+			fprintf_P(&log_stream, PSTR("auto mode aborted,\n"));
+			return;
+		default:
+			cmd_reject();
+			break;
+		}
+
 		if (millis() - prevmilis > 500)
 		{ // this is a bit of a kludge to replace the flags set in timer ISR. And since worst case all 3 are done anyway, why not do all 3 always? As long as it takes less then 500 ms...
 			prevmilis = millis();
@@ -235,146 +271,31 @@ void auto_go(profile_t *profile)
 		{
 			tmr_checktemp_flag = 0;
 
-			total_cnt++;
-
-			cur_sensor = sensor_read();
+			cur_temp = sensor_read();
 
 			if (DEMO_MODE)
 			{
 				// in demo mode, we fake the reading
-				cur_sensor = temperature_to_sensor(tgt_temp);
+				cur_temp = r.tgt_temp;
 			}
 
-			if (stage == 0) // preheat to thermal soak temperature
-			{
-				length_cnt++;
-				if (sensor_to_temperature(cur_sensor) >= profile->soak_temp1)
-				{
-					// reached soak temperature
-					stage++;
-					integral = 0.0;
-					last_error = 0.0;
-					length_cnt = 0;
-				}
-				else
-				{
-					// calculate next temperature by increasing current temperature
-					tgt_temp = max(ROOM_TEMP, start_temp) + (profile->start_rate * TMR_OVF_TIMESPAN * 256 * length_cnt);
-
-					if (length_cnt % 8 == 0)
-					{
-						start_temp = sensor_to_temperature(cur_sensor);
-						length_cnt = 0;
-					}
-
-					tgt_temp = min(tgt_temp, profile->soak_temp1);
-
-					// calculate the maximum allowable PWM duty cycle because we already know the maximum heating rate
-					// uint32_t upperlimit = lround((1.125 * 65535.0 * profile->start_rate) / max_heat_rate);
-					// upperlimit = max(upperlimit, approx_pwm(temperature_to_sensor(tgt_temp)));
+			char prev_stage = r.stage;
+			reflow_step(&r, cur_temp);
 
-					// calculate and set duty cycle
-					uint16_t pwm = pid((double)temperature_to_sensor(tgt_temp), (double)cur_sensor, &integral, &last_error);
-					pwm_ocr = pwm;
-					// pwm_ocr = pwm > upperlimit ? upperlimit : pwm;
-				}
-			}
-
-			if (stage == 1) // thermal soak stage, ensures entire PCB is evenly heated
+			if (r.stage == REFLOW_STAGE_DONE && prev_stage != REFLOW_STAGE_DONE)
 			{
-				length_cnt++;
-				if (((uint16_t)lround(length_cnt * TMR_OVF_TIMESPAN * 256) > profile->soak_length))
-				{
-					// has passed time duration, next stage
-					length_cnt = 0;
-					stage++;
-					integral = 0.0;
-					last_error = 0.0;
-				}
-				else
-				{
-					// keep the temperature steady
-					tgt_temp = (((profile->soak_temp2 - profile->soak_temp1) / profile->soak_length) * (length_cnt * TMR_OVF_TIMESPAN * 256)) + profile->soak_temp1;
-					tgt_temp = min(tgt_temp, profile->soak_temp2);
-					pwm_ocr = pid((double)temperature_to_sensor(tgt_temp), (double)cur_sensor, &integral, &last_error);
-				}
+				/* beep */
+				pin_buzzer::set();
+				delay(50);
+				pin_buzzer::clear();
 			}
 
-			if (stage == 2) // reflow stage, try to reach peak temp
-			{
-				length_cnt++;
-				if (((uint16_t)lround(length_cnt * TMR_OVF_TIMESPAN * 256) > profile->time_to_peak))
-				{
-					// has passed time duration, next stage
-					length_cnt = 0;
-					stage++;
-					integral = 0.0;
-					last_error = 0.0;
-				}
-				else
-				{
-					// raise the temperature
-					tgt_temp = (((profile->peak_temp - profile->soak_temp2) / profile->time_to_peak) * (length_cnt * TMR_OVF_TIMESPAN * 256)) + profile->soak_temp2;
-					tgt_temp = min(tgt_temp, profile->peak_temp);
-					pwm_ocr = pid((double)temperature_to_sensor(tgt_temp), (double)cur_sensor, &integral, &last_error);
-				}
-			}
+			heat_set(r.pwm_ocr); // set the heating element power
+			rec_sample(r.stage, cur_temp, r.tgt_temp);
 
-			if (stage == 3) // make sure we've reached peak temperature
-			{
-				if (sensor_to_temperature(cur_sensor) >= profile->peak_temp)
-				{
-					stage++;
-					integral = 0.0;
-					last_error = 0.0;
-					length_cnt = 0;
-				}
-				else
-				{
-					tgt_temp = profile->peak_temp + 5.0;
-					pwm_ocr = pid((double)temperature_to_sensor(tgt_temp), (double)cur_sensor, &integral, &last_error);
-				}
-			}
+			graph_timer += 256;
 
-			if (stage == 4) // cool down
-			{
-				length_cnt++;
-				if (cur_sensor < temperature_to_sensor(ROOM_TEMP * 1.25))
-				{
-					pwm_ocr = 0; // turn off
-					tgt_temp = ROOM_TEMP;
-					stage++; // stage 5 is DONE
-					/* beep */
-					PORTD |= _BV(5);
-					delay(50);
-					PORTD &= ~_BV(5);
-				}
-				else
-				{
-					// change the target temperature (limit to 0)
-
-					if (tgt_temp <= 0)
-					{
-						tgt_temp = 0;
-					}
-					else
-					{
-						tgt_temp = profile->peak_temp - (profile->cool_rate * TMR_OVF_TIMESPAN * 256 * length_cnt);
-					}
-					uint16_t pwm = pid((double)temperature_to_sensor(tgt_temp), (double)cur_sensor, &integral, &last_error);
-
-					// apply a upper limit to the duty cycle to avoid accidentally heating instead of cooling
-					// uint16_t ap = approx_pwm(temperature_to_sensor(tgt_temp));
-					// pwm_ocr = pwm > ap ? ap : pwm;
-					pwm_ocr = pwm;
-				}
-			}
-
-			heat_set(pwm_ocr); // set the heating element power
-
-			graph_timer += TMR_OVF_TIMESPAN * 256;
-
-			if ((stage != 5) && (graph_timer >= graph_tick))
+			if ((r.stage != REFLOW_STAGE_DONE) && (graph_timer >= graph_tick))
 			{
 				graph_timer -= graph_tick;
 				// it's time for a new entry on the graph
@@ -391,15 +312,12 @@ void auto_go(profile_t *profile)
 					}
 				}
 
-				// shift the graph down a bit to get more room
-				int32_t shiftdown = lround((ROOM_TEMP * 1.25 / settings.max_temp) * LCD_HEIGHT);
-
 				// calculate the graph plot entries
 
-				int32_t plan = lround((tgt_temp / settings.max_temp) * LCD_HEIGHT) - shiftdown;
+				int32_t plan = ((int32_t)r.tgt_temp * LCD_HEIGHT + graph_max / 2) / graph_max - graph_shiftdown;
 				temp_plan[temp_history_idx] = plan >= LCD_HEIGHT ? LCD_HEIGHT : (plan <= 0 ? 0 : plan);
 
-				int32_t history = lround((sensor_to_temperature(cur_sensor) / settings.max_temp) * LCD_HEIGHT) - shiftdown;
+				int32_t history = ((int32_t)cur_temp * LCD_HEIGHT + graph_max / 2) / graph_max - graph_shiftdown;
 				temp_history[temp_history_idx] = history >= LCD_HEIGHT ? LCD_HEIGHT : (history <= 0 ? 0 : history);
 
 				if (temp_history_idx < (LCD_WIDTH - 1) && (temp_plan[temp_history_idx] != 0 || temp_plan[temp_history_idx] != 0))
@@ -412,66 +330,25 @@ void auto_go(profile_t *profile)
 		if (tmr_drawlcd_flag)
 		{
 			tmr_drawlcd_flag = 0;
-			// print the graph and overlay current temperature, target temperature, and phase of reflow
-			u8g.firstPage();
-			do
-			{
-				u8g.drawStr(38, 14, "\xb0"
-									"C"); // 0xb0 is the degree sign in the unifont table
-				u8g.drawStr(25, 29, "\xb0"
-									"C set");
-				u8g.setPrintPos(0, 14);
-				u8g.print(sensor_to_temperature(cur_sensor), 1);
-				u8g.setPrintPos(0, 29);
-				u8g.print(tgt_temp, 0);
-				switch (stage)
-				{
-				case 0:
-					u8g.drawStr(0, 44, "Preheat");
-					break;
-				case 1:
-					u8g.drawStr(0, 44, "Soak");
-					break;
-				case 2:
-				case 3:
-					u8g.drawStr(0, 44, "Reflow");
-					break;
-				case 4:
-					u8g.drawStr(0, 44, "Cool");
-					break;
-				case 5:
-					u8g.drawStr(0, 44, "Done");
-					break;
-				default:
-					u8g.drawStr(0, 44, "oops!");
-					break;
-				}
-				if (DEMO_MODE)
-				{
-					u8g.drawStr(0, 60, "DEMO");
-				}
-
-				// always draw graph, otherwise it gets erased next display refresh
-				for (unsigned char x = 0; x < LCD_WIDTH; x++)
-				{
-					u8g.drawPixel(x, LCD_HEIGHT - temp_history[x]);
-					// graph scaling is done when saving the values
-				};
-
-			} while (u8g.nextPage());
+			auto_draw(&r, cur_temp);
 		}
 
-		if (tmr_writelog_flag)
+		if (tmr_writelog_flag && cmd_telemetry)
 		{
 			tmr_writelog_flag = 0;
 
 			// print to CSV log format
-			fprintf_P(&log_stream, PSTR("%d, "), stage);
-			fprintf_P(&log_stream, PSTR("%s, "), str_from_double(total_cnt * TMR_OVF_TIMESPAN * 256, 1));
-			fprintf_P(&log_stream, PSTR("%d, "), cur_sensor);
-			fprintf_P(&log_stream, PSTR("%d, "), temperature_to_sensor(tgt_temp));
-
-			fprintf_P(&log_stream, PSTR("%s,\n"), str_from_int(pwm_ocr));
+			fprintf_P(&log_stream, PSTR("%d, "), r.stage);
+			fprintf_P(&log_stream, PSTR("%s, "), str_from_deci((r.total_cnt * LOG_TIME_NUM + LOG_TIME_DEN / 2) / LOG_TIME_DEN));
+			fprintf_P(&log_stream, PSTR("%s, "), str_from_deci(cur_temp));
+			fprintf_P(&log_stream, PSTR("%s, "), str_from_deci(r.tgt_temp));
+
+#if SENSOR_CHANNELS > 1
+			fprintf_P(&log_stream, PSTR("%s, "), str_from_int(r.pwm_ocr));
+			fprintf_P(&log_stream, PSTR("%s,\n"), str_from_deci(sensor_read_channel(1))); // the air, cur_temp is what the control works on
+#else
+			fprintf_P(&log_stream, PSTR("%s,\n"), str_from_int(r.pwm_ocr));
+#endif
 
 			// fprintf_P(&log_stream, PSTR("%s, "), str_from_int(pwm_ocr));
 			// fprintf_P(&log_stream, PSTR("%s,\n"), str_from_double(integral, 1));
@@ -480,7 +357,7 @@ void auto_go(profile_t *profile)
 		// hold down mid button to stop
 		if (button_enter())
 		{
-			if (stage != 5)
+			if (r.stage != REFLOW_STAGE_DONE)
 			{
 				u8g.firstPage();
 				do
@@ -493,53 +370,21 @@ void auto_go(profile_t *profile)
 				;
 			delay(25);
 
-			if (stage != 5)
+			if (r.stage != REFLOW_STAGE_DONE)
 			{
-				stage = 5;
+				r.stage = REFLOW_STAGE_DONE;
 			}
 			else
 			{
 				// release and hold down again to exit
+				rec_stop();
+				cmd_run(0);
 				return;
 			}
 		}
 	}
 }
 
-void profile_setdefault(profile_t *profile)
-{
-	profile->start_rate = 1;
-	profile->soak_temp1 = 150.0;
-	profile->soak_temp2 = 185.0;
-	profile->soak_length = 70;
-	profile->peak_temp = 217.5;
-	profile->time_to_peak = 45;
-	profile->cool_rate = 2.0;
-}
-
-void settings_setdefault(settings_t *s)
-{
-	s->pid_p = 2000.0;
-	s->pid_i = 5.00;
-	s->pid_d = -0.01;
-	s->max_temp = 230.0;
-	s->time_to_max = 220.0;
-}
-
-char profile_valid(profile_t *profile)
-{
-	return (profile->start_rate > 0.0 &&
-			profile->soak_temp1 > 0.0 &&
-			profile->soak_temp2 >= profile->soak_temp1 &&
-			profile->peak_temp >= profile->soak_temp2 &&
-			profile->cool_rate > 0.0);
-}
-
-char settings_valid(settings_t *s)
-{
-	return (s->max_temp > 0.0 && s->time_to_max > 0.0);
-}
-
 static int log_putchar_stream(char c, FILE *stream)
 {
 	if (c == '\n')
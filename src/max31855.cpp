@@ -0,0 +1,155 @@
+/* SPI thermocouple converters
+ *
+ * Drivers for the MAX31855 and the older MAX6675, see sensor_driver_t in temperaturemeasurement.h.
+ * Both convert continuously while CS is high and are read by pulling CS low and clocking the
+ * result out, so there is no square wave to filter: a reading is the temperature.
+ *
+ *   MAX31855, 32 bits: D31-D18 thermocouple temperature in 0.25 C (signed), D16 fault,
+ *             D15-D4 cold junction temperature, D2 short to VCC, D1 short to GND, D0 open
+ *   MAX6675,  16 bits: D14-D3 temperature in 0.25 C, D2 open
+ *
+ * Uses the hardware SPI (the pin_spi_ pins and MISO) with CS on pin_tc_cs, which is SS on the oven
+ * board. A second converter (SENSOR_CHANNELS 2) has CS on pin_tc_cs_air, see board.h.
+ */
+
+#include <avr/io.h>
+#include <Arduino.h> // millis
+
+#include "reflowtoasteroven.h"
+#include "temperaturemeasurement.h"
+#include "board.h"
+
+#define MAX31855_INTERVAL 100 // ms between readings, conversion takes up to 100 ms, reading earlier restarts it
+#define MAX6675_INTERVAL 220
+static_assert(F_CPU / 16 <= 4300000, "the SPI clock has to stay under the 4.3 MHz of the MAX6675");
+
+static uint32_t tc_data[SENSOR_CHANNELS];
+static uint32_t tc_last_ms;
+
+// chip select is low active
+static void tc_select(uint8_t channel, char selected)
+{
+	if (channel == 0)
+	{
+		if (selected)
+		{
+			pin_tc_cs::clear();
+		}
+		else
+		{
+			pin_tc_cs::set();
+		}
+	}
+	else
+	{
+		if (selected)
+		{
+			pin_tc_cs_air::clear();
+		}
+		else
+		{
+			pin_tc_cs_air::set();
+		}
+	}
+}
+
+static void tc_init()
+{
+	for (uint8_t i = 0; i < SENSOR_CHANNELS; i++)
+	{
+		tc_select(i, 0);
+	}
+	pin_tc_cs::output();
+	if (SENSOR_CHANNELS > 1)
+	{
+		pin_tc_cs_air::output();
+	}
+	pin_spi_sck::output();
+	pin_spi_mosi::output();
+	pin_spi_ss::output();
+	SPCR = _BV(SPE) | _BV(MSTR) | _BV(SPR0); // mode 0, F_CPU / 16, 500 kHz at 8 MHz
+}
+
+static void tc_start()
+{
+	tc_last_ms = millis() - MAX6675_INTERVAL; // the converter has been running, the first poll reads
+}
+
+static uint32_t tc_transfer(uint8_t channel, uint8_t bytes)
+{
+	uint32_t data = 0;
+	tc_select(channel, 1);
+	for (uint8_t i = 0; i < bytes; i++)
+	{
+		SPDR = 0;
+		while (!(SPSR & _BV(SPIF)))
+		{
+		}
+		data = (data << 8) | SPDR;
+	}
+	tc_select(channel, 0);
+	return data;
+}
+
+// reads all converters once the interval has passed
+static char tc_poll(uint16_t interval, uint8_t bytes)
+{
+	uint32_t now = millis();
+	if (now - tc_last_ms < interval)
+	{
+		return 0;
+	}
+	tc_last_ms = now;
+	for (uint8_t i = 0; i < SENSOR_CHANNELS; i++)
+	{
+		tc_data[i] = tc_transfer(i, bytes);
+	}
+	return 1;
+}
+
+static char max31855_poll()
+{
+	return tc_poll(MAX31855_INTERVAL, 4);
+}
+
+static int32_t max31855_read(uint8_t channel)
+{
+	return ((int32_t)tc_data[channel] >> 18) * 25;
+}
+
+static uint8_t max31855_fault(uint8_t channel)
+{
+	uint32_t data = tc_data[channel];
+	if (data == 0xFFFFFFFF || data == 0)
+	{
+		return SENSOR_NO_DEVICE; // MISO floating or held, a real reading has the cold junction at least
+	}
+	if (data & 0x10000UL)
+	{
+		return (data & 0x07) ? (data & 0x07) : SENSOR_OPEN; // D0-D2 are in the same order as the SENSOR_ bits
+	}
+	return 0;
+}
+
+static char max6675_poll()
+{
+	return tc_poll(MAX6675_INTERVAL, 2);
+}
+
+static int32_t max6675_read(uint8_t channel)
+{
+	return (int32_t)((tc_data[channel] >> 3) & 0x0FFF) * 25;
+}
+
+static uint8_t max6675_fault(uint8_t channel)
+{
+	uint32_t data = tc_data[channel];
+	if (data == 0xFFFF || (data & 0x02))
+	{
+		return SENSOR_NO_DEVICE; // D1 is always 0 on a real MAX6675
+	}
+	return (data & 0x04) ? SENSOR_OPEN : 0;
+}
+
+const sensor_driver_t sensor_max31855 = {tc_init, tc_start, max31855_poll, max31855_read, max31855_fault, &calibration_none};
+const sensor_driver_t sensor_max6675 = {tc_init, tc_start, max6675_poll, max6675_read, max6675_fault, &calibration_none};
@@ -0,0 +1,64 @@
+/* RAM headroom
+ *
+ * At reset, before the C runtime starts, all RAM above the static data is painted with STACK_CANARY.
+ * The stack grows down into it, so the canaries that are left at the bottom tell how deep it has
+ * ever been. The serial command "mem" prints the numbers.
+ */
+
+#include <avr/io.h>
+
+#include "reflowtoasteroven.h"
+#include "meminfo.h"
+
+#if STACK_MONITOR
+
+extern "C" uint8_t __heap_start; // end of the static data, from the linker script
+extern "C" char *__brkval;		 // top of the heap, 0 until the first malloc
+
+// .init1 runs before the stack pointer and the zero register are set up, so this is assembly only
+// and falls through to .init2 instead of returning
+static void stack_paint() __attribute__((naked, used, section(".init1")));
+static void stack_paint()
+{
+	asm volatile(
+		"	ldi r30, lo8(__heap_start)\n"
+		"	ldi r31, hi8(__heap_start)\n"
+		"	ldi r24, %0\n"
+		"	ldi r25, hi8(__stack)\n"
+		"	rjmp 2f\n"
+		"1:	st Z+, r24\n"
+		"2:	cpi r30, lo8(__stack)\n"
+		"	cpc r31, r25\n"
+		"	brlo 1b\n"
+		"	breq 1b\n"
+		:
+		: "M"(STACK_CANARY));
+}
+
+static uint8_t *heap_end()
+{
+	return __brkval ? (uint8_t *)__brkval : &__heap_start;
+}
+
+uint16_t mem_static()
+{
+	return (uintptr_t)&__heap_start - RAMSTART;
+}
+
+uint16_t mem_free()
+{
+	return SP - (uintptr_t)heap_end();
+}
+
+uint16_t mem_stack_unused()
+{
+	const uint8_t *p = heap_end();
+	uint16_t n = 0;
+	while ((uintptr_t)(p + n) < SP && p[n] == STACK_CANARY)
+	{
+		n++;
+	}
+	return n;
+}
+
+#endif
@@ -37,13 +37,12 @@
 #include "userinput.h"
 #include "lcd.h"
 #include "nvm.h" // so settings can be loaded and saved
+#include "serialcmd.h"
+#include "autotune.h"
 #include <string.h>
 #include <stdlib.h>
 #include <avr/pgmspace.h>
 
-// this string is allocated for temporary use
-char strbuf[(LCD_WIDTH / FONT_WIDTH) + 2];
-
 //change a value, between limits, with the rotary encoder, for use in loops and with doubles.
 double change_value_double(double oldvalue, double increment, double limit1, double limit2){
 	double temp;
@@ -66,37 +65,17 @@ int32_t change_value_int(int32_t oldvalue, int32_t increment, int32_t limit1, in
 	return (temp > maxlimit) ? maxlimit : ((temp < minlimit) ? minlimit : temp);
 }
 
-char *str_from_int(signed long value)
-{
-	return ltoa(value, strbuf, 10);
-}
-
-char *str_from_double(double value, int decimalplaces)
-{
-	char *result = dtostrf(value, -(LCD_WIDTH / FONT_WIDTH), decimalplaces, strbuf);
-
-	// trim trailing spaces
-	int8_t len = strlen(result);
-	len--;
-	while (result[len] == ' ' && len >= 0)
-	{
-		result[len] = 0;
-		len--;
-	}
-	return result;
-}
-
 void menu_manual_pwm_ctrl()
 {
 	uint16_t iteration = 0;
 	int32_t rot_enc_val;
 	uint16_t pwm = 0;
-	uint16_t cur_sensor = sensor_read();
-	uint16_t cur_temp = 0;
+	int16_t cur_temp = sensor_read();
 	unsigned long prevmillis;
 
 	sensor_filter_reset();
 	settings_load(&settings); // load from eeprom
+	int16_t max_temp = temperature_to_deci(settings.max_temp);
 
 	// signal start of mode in log
 	fprintf_P(&log_stream, PSTR("manual PWM control mode,\n"));
@@ -106,6 +85,24 @@ void menu_manual_pwm_ctrl()
 	
 	while (1)
 	{
+		// remote control, the PWM setpoint is kept in the rotary encoder count just like a turn of the knob
+		switch (cmd_poll())
+		{
+		case CMD_NONE:
+			break;
+		case CMD_PWM:
+			RotEnc.write(lround(cmd_arg / 1024 * ROTENC_PPS));
+			cmd_accept();
+			break;
+		case CMD_ABORT:
+			cmd_accept();
+			// fall through
+		default: // leave other actions pending for the main menu
+			heat_set(0);
+			RotEnc.write(0);
+			return;
+		}
+
 		heat_set(pwm);
 		rot_enc_val = 1024*RotEnc.read()/ROTENC_PPS;
 
@@ -129,16 +126,14 @@ void menu_manual_pwm_ctrl()
 			u8g.drawStr(110, 28, "\xb0""C"); // 0xb0 is the degree-sign in the unifont table
 			u8g.drawStr(0, 60, "Tick");
 			u8g.setPrintPos(80, 28);
-			u8g.print(cur_temp, DEC);
+			u8g.print(cur_temp / 10, DEC);
 			u8g.setPrintPos(80, 12);
 			u8g.print(pwm, DEC);
-			u8g.setPrintPos(80, 28);
-			u8g.print(cur_temp, DEC);
 			u8g.setPrintPos(80, 60);
 			u8g.print(iteration, DEC);
 		} while (u8g.nextPage());
 
-		if(cur_temp > settings.max_temp){ // very rudimentary overtemperature protection. ALSO USE A THERMO FUSE!
+		if(cur_temp > max_temp){ // very rudimentary overtemperature protection. ALSO USE A THERMO FUSE!
 			pwm=0;
 			RotEnc.write(0);			// also reset the rotary encoder to zero, so it needs human interaction to change the PWM from 0 even after oven cooled down a bit
 		}
@@ -159,13 +154,12 @@ void menu_manual_pwm_ctrl()
 			// every half a second, read temperature and run PID
 			prevmillis = millis();
 			iteration++;
-			cur_sensor = sensor_read();
-			cur_temp = sensor_to_temperature(cur_sensor);
-		if(iteration&0x01)
+			cur_temp = sensor_read();
+		if((iteration&0x01) && cmd_telemetry)
 			{
 				// every second, write log too
 				fprintf_P(&log_stream, PSTR("%s, "), str_from_double(iteration / 2, 1));
-				fprintf_P(&log_stream, PSTR("%s, "), str_from_int(cur_sensor));
+				fprintf_P(&log_stream, PSTR("%s, "), str_from_deci(cur_temp));
 				fprintf_P(&log_stream, PSTR("%s,\n"), str_from_int(pwm));
 			}
 		}
@@ -177,15 +171,15 @@ void menu_manual_temp_ctrl()
 	uint16_t iteration = 0;
 	uint16_t cur_pwm = 0;
 	double tgt_temp = 0;
-	double integral = 0.0, last_error = 0.0;
-	uint16_t tgt_sensor = temperature_to_sensor((double)tgt_temp);
-	uint16_t cur_sensor = sensor_read();
-	uint16_t cur_temp = 0;
+	int32_t integral = 0;
+	int16_t last_error = 0;
+	int16_t cur_temp = sensor_read();
 	unsigned long prevmillis;
 
 	sensor_filter_reset();
 
 	settings_load(&settings); // load from eeprom
+	pid_init();
 
 	// signal start of mode in log
 	fprintf_P(&log_stream, PSTR("manual temperature control mode,\n"));
@@ -195,6 +189,24 @@ void menu_manual_temp_ctrl()
 	
 	while (1)
 	{
+		// remote control, the temperature setpoint is kept in the rotary encoder count just like a turn of the knob
+		switch (cmd_poll())
+		{
+		case CMD_NONE:
+			break;
+		case CMD_TEMP:
+			RotEnc.write(lround(cmd_arg) * ROTENC_PPS);
+			cmd_accept();
+			break;
+		case CMD_ABORT:
+			cmd_accept();
+			// fall through
+		default: // leave other actions pending for the main menu
+			heat_set(0);
+			RotEnc.write(0);
+			return;
+		}
+
 		heat_set(cur_pwm);
 
 		//todo: this can be done smarter/faster then with a lot of doubles, maybe look into later if needed. Or could use change_value_double()...); function...
@@ -219,7 +231,7 @@ void menu_manual_temp_ctrl()
 			u8g.drawStr(0, 29, "PWM @ ");
 			u8g.drawStr(0, 43, "Tick");
 			u8g.setPrintPos(0, 14);
-			u8g.print(cur_temp, DEC);
+			u8g.print(cur_temp / 10, DEC);
 			u8g.setPrintPos(85, 14);
 			u8g.print(tgt_temp, 0);
 			u8g.setPrintPos(85, 29);
@@ -245,74 +257,98 @@ void menu_manual_temp_ctrl()
 			// every half a second, read temperature and run PID
 			prevmillis = millis();
 			iteration++;
-			cur_sensor = sensor_read();
-			cur_temp = sensor_to_temperature(cur_sensor);
-			tgt_sensor = temperature_to_sensor((double)tgt_temp); // todo: maybe convert this just once after setting tgt?
-			cur_pwm = pid((double)tgt_sensor, (double)cur_sensor, &integral, &last_error);
-		if(iteration&0x01)
+			cur_temp = sensor_read();
+			int16_t tgt = temperature_to_deci(tgt_temp);
+			cur_pwm = pid(tgt, cur_temp, &integral, &last_error, 0);
+		if((iteration&0x01) && cmd_telemetry)
 			{
 				// every second, write log too
 				// fprintf_P(&log_stream, PSTR("%s, "), str_from_double(iteration * TMR_OVF_TIMESPAN * 512, 1));
 				fprintf_P(&log_stream, PSTR("%s, "), str_from_double(iteration / 2, 1));
-				fprintf_P(&log_stream, PSTR("%s, "), str_from_int(cur_sensor));
-				fprintf_P(&log_stream, PSTR("%s, "), str_from_int(tgt_temp));
+				fprintf_P(&log_stream, PSTR("%s, "), str_from_deci(cur_temp));
+				fprintf_P(&log_stream, PSTR("%s, "), str_from_deci(tgt));
 				fprintf_P(&log_stream, PSTR("%s,\n"), str_from_int(cur_pwm));
 			}
 		}
 	}
 }
 
+// the rows of the profile menu, a segment per row and 4 rows to a page
+#define PROFILE_ITEM_SAVE PROFILE_SEGMENTS
+#define PROFILE_ITEM_CANCEL (PROFILE_SEGMENTS + 1)
+#define PROFILE_ITEMS (PROFILE_SEGMENTS + 2)
+
+const char *segment_name(uint8_t type)
+{
+	switch (type)
+	{
+	case SEGMENT_RAMP:
+		return "Ramp";
+	case SEGMENT_RAMP_TIME:
+		return "RampT";
+	case SEGMENT_HOLD:
+		return "Hold";
+	case SEGMENT_WAIT:
+		return "Wait";
+	case SEGMENT_COOL:
+		return "Cool";
+	default:
+		return "End";
+	}
+}
+
+static void draw_segment(profile_t *profile, unsigned char item, unsigned char y)
+{
+	if (item == PROFILE_ITEM_SAVE)
+	{
+		u8g.drawStr(6, y, "Save & exit");
+	}
+	else if (item == PROFILE_ITEM_CANCEL)
+	{
+		u8g.drawStr(6, y, "Cancel & exit");
+	}
+	else if (item < PROFILE_SEGMENTS)
+	{
+		segment_t *seg = &profile->seg[item];
+		u8g.drawStr(6, y, segment_name(seg->type));
+		if (seg->type != SEGMENT_END)
+		{
+			u8g.setPrintPos(50, y);
+			u8g.print(seg->temp / 10.0, 0);
+			u8g.setPrintPos(82, y);
+			u8g.print(segment_value(seg), (seg->type == SEGMENT_RAMP || seg->type == SEGMENT_COOL) ? 2 : (seg->type == SEGMENT_WAIT ? 1 : 0));
+		}
+	}
+}
+
 void menu_edit_profile(profile_t *profile)
 {
 	//profile_load(&profile); // load from eeprom -- already loaded in "auto reflow" menu, which is the only way to enter this.
 	unsigned char selection = 0;
+	unsigned char field = 0; // 0 selects a row, 1 to 3 edit the type, temperature and value of its segment
+	static const unsigned char field_x[] = {6, 50, 82};
 	fprintf_P(&log_stream, PSTR("Edit profile Menu,\n"));
-	unsigned char selecting = 1;
 
 	while (1)
 	{
 		heat_set(0); // turn off for safety
-		
+
 		// u8glib picture loop
 		u8g.firstPage();
 		do
 		{
-			if(selection<4){
-			u8g.drawStr(0, 12 + 16 * selection, ">"); // mark selection
-			u8g.drawStr(6, 12, "Start Rate");
-			u8g.drawStr(6, 28, "Soak 1");
-			u8g.drawStr(6, 44, "Soak 2");
-			u8g.drawStr(6, 60, "Soak time"); 
-			u8g.drawStr(110, 28, "\xb0""C");
-			u8g.drawStr(110, 44, "\xb0""C");
-			u8g.drawStr(120, 60, "Soak time"); 
-			// the degree sign is 176 in the unifont font table, but without prefixed x the number is octal so x0b was simpler, but the the C is seen as hex too, so use string concatenation
-			u8g.setPrintPos(100, 12);
-			u8g.print(profile->start_rate, 1);
-			u8g.setPrintPos(85, 28);
-			u8g.print(profile->soak_temp1, 0);
-			u8g.setPrintPos(85, 44);
-			u8g.print(profile->soak_temp2, 0);
-			u8g.setPrintPos(85, 60);
-			u8g.print(profile->soak_length, 1);
-			}
-			else{
-				u8g.drawStr(0, 12 + 16 * (selection-4), ">"); // mark selection
-				u8g.drawStr(6, 14, "Peak T");
-				u8g.drawStr(6, 29, "Peak t");
-				u8g.drawStr(110, 14, "\xb0""C");
-				u8g.drawStr(110, 29, "s");
-				u8g.drawStr(6, 44, "Cool Rate");
-				u8g.drawStr(6, 60, "Save & exit"); // TODO: option to exit without saving
-				u8g.setPrintPos(85, 12);
-				u8g.print(profile->peak_temp, 0);
-				u8g.setPrintPos(85, 28);
-				u8g.print(profile->time_to_peak, DEC);
-				u8g.setPrintPos(85, 44);
-				u8g.print(profile->cool_rate, 2);
+			unsigned char page = selection & ~0x03;
+			u8g.drawStr(0, 12 + 16 * (selection - page), ">"); // mark selection
+			for (unsigned char row = 0; row < 4; row++)
+			{
+				draw_segment(profile, page + row, 12 + 16 * row);
+			}
+			if (field != 0)
+			{
+				u8g.drawHLine(field_x[field - 1], 14 + 16 * (selection - page), 32); // underline what is edited
 			}
 		} while (u8g.nextPage());
-		
+
 		if (button_enter())
 		{
 			delay(25);
@@ -320,63 +356,79 @@ void menu_edit_profile(profile_t *profile)
 				;
 			delay(25);
 			RotEnc.write(0); // reset rotary encoder before entering next mode...
-			selecting ^= 0x01 ; // exor = toggle selecting - if enter is pressed on a value edit that value untill enter is pressed again.
 
-			// act on the selection (return to main or reset...)
-			if(selection == 7){
-				 // save settings and return to main
-					if (profile_valid(profile))
-					{
-						profile_save(profile); // save to eeprom
-						return;
-					}
-					else
-					{
-						u8g.firstPage();
-						do
-						{
-						u8g.drawStr(0, 12, "Error in pro-");
-						u8g.drawStr(0, 28, "file, please");
-						u8g.drawStr(0, 28, "Review & fix");
-						} while (u8g.nextPage());
-						_delay_ms(1000);
-						selecting = 1; // back to select which setting to correct
-					}
+			if (selection == PROFILE_ITEM_SAVE)
+			{
+				if (profile_valid(profile))
+				{
+					profile_save(profile); // save to eeprom
+					return;
 				}
+				u8g.firstPage();
+				do
+				{
+					u8g.drawStr(0, 12, "Error in pro-");
+					u8g.drawStr(0, 28, "file, please");
+					u8g.drawStr(0, 44, "Review & fix");
+				} while (u8g.nextPage());
+				_delay_ms(1000);
+				RotEnc.write(selection * ROTENC_PPS);
+			}
+			else if (selection == PROFILE_ITEM_CANCEL)
+			{
+				profile_load(profile); // discard the changes
+				return;
+			}
+			else
+			{
+				// next field, an unused segment only has a type
+				field++;
+				if (field > 3 || (field > 1 && profile->seg[selection].type == SEGMENT_END))
+				{
+					field = 0;
+					RotEnc.write(selection * ROTENC_PPS); // stay on this row
+				}
+			}
 		}
 
-		// edit values if not selecting
-		if(selecting == 1){
+		if (field == 0)
+		{
 			selection = (RotEnc.read() / ROTENC_PPS);
-			if(selection>254){ 		// underflow
-				RotEnc.write(7*ROTENC_PPS); 
-			}else if (selection>7){ // overflow
+			if (selection > 254)
+			{ // underflow
+				RotEnc.write((PROFILE_ITEMS - 1) * ROTENC_PPS);
+				selection = PROFILE_ITEMS - 1;
+			}
+			else if (selection > PROFILE_ITEMS - 1)
+			{ // overflow
 				RotEnc.write(0);
+				selection = 0;
 			}
 		}
 		else
 		{
-			switch(selection){
-			case 0:
-				profile->start_rate = change_value_double(profile->start_rate, 0.1, 0.1, 5.0);
-				break;
+			segment_t *seg = &profile->seg[selection];
+			switch (field)
+			{
 			case 1:
-				profile->soak_temp1 = change_value_double(profile->soak_temp1, 1, 50, 300);
+				seg->type = change_value_int(seg->type, 1, SEGMENT_END, SEGMENT_TYPES - 1);
 				break;
-			case 2:
-				profile->soak_temp2 = change_value_double(profile->soak_temp2, 1, 50, 300);
+			case 2: // 1 C steps
+				seg->temp = change_value_int(seg->temp, 10, 100, SEGMENT_TEMP_MAX);
 				break;
-			case 3:
-				profile->soak_length = change_value_int(profile->soak_length, 1, 60, 60*5);
-				break;
-			case 4:
-				profile->peak_temp = change_value_double(profile->peak_temp, 1, 150, 350);
-				break;
-			case 5:
-				profile->time_to_peak = change_value_int(profile->time_to_peak, 1, 0, 60*5);
-				break;
-			case 6:
-				profile->cool_rate = change_value_double(profile->cool_rate, 0.1, 0.1, 5.0);
+			case 3: // 0.1 C/s, 1 s or 0.5 C steps
+				if (seg->type == SEGMENT_RAMP || seg->type == SEGMENT_COOL)
+				{
+					seg->value = change_value_int(seg->value, 10, 10, 500);
+				}
+				else if (seg->type == SEGMENT_WAIT)
+				{
+					seg->value = change_value_int(seg->value, 5, 0, 200);
+				}
+				else
+				{
+					seg->value = change_value_int(seg->value, 1, seg->type == SEGMENT_RAMP_TIME, 36000);
+				}
 				break;
 			default:
 				break;
@@ -385,29 +437,126 @@ void menu_edit_profile(profile_t *profile)
 	}
 }
 
+// lists the profile slots by name, the one that is picked becomes the selected profile
+void menu_select_profile()
+{
+	char names[PROFILE_SLOTS][PROFILE_NAME_SIZE + 1];
+	unsigned char selection = profile_selected();
+	for (unsigned char slot = 0; slot < PROFILE_SLOTS; slot++)
+	{
+		profile_name(slot, names[slot]); // only the directory is read, not the profiles
+	}
+	RotEnc.write(selection * ROTENC_PPS);
+
+	while (1)
+	{
+		heat_set(0); // turn off for safety
+		selection = (RotEnc.read() / ROTENC_PPS);
+		if (selection > 254)
+		{ // underflow
+			RotEnc.write((PROFILE_SLOTS - 1) * ROTENC_PPS);
+			selection = PROFILE_SLOTS - 1;
+		}
+		else if (selection > PROFILE_SLOTS - 1)
+		{ // overflow
+			RotEnc.write(0);
+			selection = 0;
+		}
+
+		u8g.firstPage();
+		do
+		{
+			unsigned char page = selection & ~0x03;
+			u8g.drawStr(0, 12 + 16 * (selection - page), ">"); // mark selection
+			for (unsigned char row = 0; row < 4 && page + row < PROFILE_SLOTS; row++)
+			{
+				u8g.drawStr(6, 12 + 16 * row, names[page + row]);
+			}
+		} while (u8g.nextPage());
+
+		if (button_enter())
+		{
+			delay(25);
+			while (button_enter())
+				;
+			delay(25);
+			RotEnc.write(0); // reset rotary encoder before entering next mode...
+			profile_select(selection);
+			fprintf_P(&log_stream, PSTR("profile %d selected, %s,\n"), selection + 1, names[selection]);
+			return;
+		}
+	}
+}
+
+// the items of the auto mode menu, 4 to a page
+#define AUTO_ITEM_START 0
+#define AUTO_ITEM_SELECT 1
+#define AUTO_ITEM_EDIT 2
+#define AUTO_ITEM_RESET 3
+#define AUTO_ITEM_BACK 4
+#define AUTO_ITEMS 5
+
 void menu_auto_mode()
 {
 
 	unsigned char selection = 0;
 	static profile_t profile;
-	profile_load(&profile); // load from eeprom
+	char name[PROFILE_NAME_SIZE + 1];
+	profile_load(&profile); // load from eeprom, only the selected profile
+	profile_name(profile_selected(), name);
 	fprintf_P(&log_stream, PSTR("Auto Mode Menu,\n"));
 	heat_set(0); // start with heater OFF
 
 	while (1)
 	{
 		heat_set(0); // turn off for safety
-		selection = (RotEnc.read() / ROTENC_PPS) & 0x03; // only allow 0,1,2,3 - mask instead of modulo so it wont go negative either.
+		selection = (RotEnc.read() / ROTENC_PPS);
+		if (selection > 254)
+		{ // underflow
+			RotEnc.write((AUTO_ITEMS - 1) * ROTENC_PPS);
+			selection = AUTO_ITEMS - 1;
+		}
+		else if (selection > AUTO_ITEMS - 1)
+		{ // overflow
+			RotEnc.write(0);
+			selection = 0;
+		}
+
+		if (cmd_poll() != CMD_NONE)
+		{
+			return; // remote actions are handled by the main menu
+		}
 
 		// u8glib picture loop
 		u8g.firstPage();
 		do
 		{
-			u8g.drawStr(0, 12 + 16 * selection, ">"); // mark selection (font heigt * selection modulo number of items, distance, marker) TODO: use font height and width read from font setting if possible
-			u8g.drawStr(6, 12, "Start");
-			u8g.drawStr(6, 28, "Edit profile");
-			u8g.drawStr(6, 44, "Reset profile");
-			u8g.drawStr(6, 60, "Back to main");
+			unsigned char page = selection & ~0x03;
+			u8g.drawStr(0, 12 + 16 * (selection - page), ">"); // mark selection
+			for (unsigned char row = 0; row < 4; row++)
+			{
+				unsigned char y = 12 + 16 * row;
+				switch (page + row)
+				{
+				case AUTO_ITEM_START:
+					u8g.drawStr(6, y, "Start");
+					break;
+				case AUTO_ITEM_SELECT:
+					u8g.drawStr(6, y, name); // the selected profile, enter to pick another one
+					break;
+				case AUTO_ITEM_EDIT:
+					u8g.drawStr(6, y, "Edit profile");
+					break;
+				case AUTO_ITEM_RESET:
+					u8g.drawStr(6, y, "Reset profile");
+					break;
+				case AUTO_ITEM_BACK:
+					u8g.drawStr(6, y, "Back to main");
+					break;
+				default:
+					break;
+				}
+			}
 		} while (u8g.nextPage());
 		
 		if (button_enter())
@@ -420,14 +569,20 @@ void menu_auto_mode()
 
 			// enter the submenu that is selected
 		switch(selection){
-			case 0: // start
-				auto_go(&profile); // TODO: maybe make something to select from multiple profiles?
+			case AUTO_ITEM_START:
+				auto_go(&profile);
 				return;// go back to home menu when finished
 				break;
-			case 1: // edit profile
+			case AUTO_ITEM_SELECT:
+				menu_select_profile();
+				profile_load(&profile);
+				profile_name(profile_selected(), name);
+				RotEnc.write(AUTO_ITEM_START * ROTENC_PPS); // ready to start it
+			break;
+			case AUTO_ITEM_EDIT:
 				menu_edit_profile(&profile);
 			break;
-			case 2: // reset profile
+			case AUTO_ITEM_RESET:
 				profile_setdefault(&profile);
 				profile_save(&profile); // save to eeprom
 				u8g.firstPage();
@@ -438,7 +593,7 @@ void menu_auto_mode()
 				} while (u8g.nextPage());
 				delay(1000);
 			break;
-			case 3: // back to main menu
+			case AUTO_ITEM_BACK: // back to main menu
 				return;
 				break;
 			default:
@@ -448,6 +603,81 @@ void menu_auto_mode()
 	}
 }
 
+// the items of the settings menu, 4 to a page
+#define SETTINGS_ITEM_RESET 10
+#define SETTINGS_ITEM_SAVE 11
+#define SETTINGS_ITEM_CANCEL 12
+#define SETTINGS_ITEMS 13
+
+static void draw_setting(unsigned char item, unsigned char y)
+{
+	switch (item)
+	{
+	case 0:
+		u8g.drawStr(6, y, "PID P =");
+		u8g.setPrintPos(64, y);
+		u8g.print(settings.pid_p, GAIN_DECIMALS);
+		break;
+	case 1:
+		u8g.drawStr(6, y, "PID I =");
+		u8g.setPrintPos(64, y);
+		u8g.print(settings.pid_i, GAIN_DECIMALS);
+		break;
+	case 2:
+		u8g.drawStr(6, y, "PID D =");
+		u8g.setPrintPos(64, y);
+		u8g.print(settings.pid_d, GAIN_DECIMALS);
+		break;
+	case 3:
+		u8g.drawStr(6, y, "Max\xb0""C");
+		// the degree sign is 176 in the unifont font table, but without prefixed x the number is octal so x0b was simpler, but the the C is seen as hex too, so use string concatenation
+		u8g.setPrintPos(70, y);
+		u8g.print(settings.max_temp, 1);
+		break;
+	case 4:
+		u8g.drawStr(6, y, "Time to Max");
+		u8g.setPrintPos(100, y);
+		u8g.print(settings.time_to_max, 0);
+		break;
+	case 5:
+		u8g.drawStr(6, y, "Hot P =");
+		u8g.setPrintPos(64, y);
+		u8g.print(settings.pid_p_hot, GAIN_DECIMALS);
+		break;
+	case 6:
+		u8g.drawStr(6, y, "Hot I =");
+		u8g.setPrintPos(64, y);
+		u8g.print(settings.pid_i_hot, GAIN_DECIMALS);
+		break;
+	case 7:
+		u8g.drawStr(6, y, "Hot D =");
+		u8g.setPrintPos(64, y);
+		u8g.print(settings.pid_d_hot, GAIN_DECIMALS);
+		break;
+	case 8:
+		u8g.drawStr(6, y, "Blend\xb0""C");
+		u8g.setPrintPos(70, y);
+		u8g.print(settings.sched_low, 0);
+		break;
+	case 9:
+		u8g.drawStr(6, y, "Hot\xb0""C");
+		u8g.setPrintPos(70, y);
+		u8g.print(settings.sched_high, 0);
+		break;
+	case SETTINGS_ITEM_RESET:
+		u8g.drawStr(6, y, "Reset defaults");
+		break;
+	case SETTINGS_ITEM_SAVE:
+		u8g.drawStr(6, y, "Save & exit");
+		break;
+	case SETTINGS_ITEM_CANCEL:
+		u8g.drawStr(6, y, "Cancel & exit");
+		break;
+	default:
+		break;
+	}
+}
+
 void menu_edit_settings()
 {
 	heat_set(0); // heater off
@@ -464,30 +694,11 @@ void menu_edit_settings()
 		u8g.firstPage();
 		do
 		{
-			if(selection<4){
-			u8g.drawStr(0, 12 + 16 * selection, ">"); // mark selection
-			u8g.drawStr(6, 12, "PID P =");
-			u8g.drawStr(6, 28, "PID I =");
-			u8g.drawStr(6, 44, "PID D =");
-			u8g.drawStr(6, 60, "Max\xb0""C"); 
-			// the degree sign is 176 in the unifont font table, but without prefixed x the number is octal so x0b was simpler, but the the C is seen as hex too, so use string concatenation
-			u8g.setPrintPos(70, 12);
-			u8g.print(settings.pid_p, 2);
-			u8g.setPrintPos(70, 28);
-			u8g.print(settings.pid_i, 2);
-			u8g.setPrintPos(70, 44);
-			u8g.print(settings.pid_d, 2);
-			u8g.setPrintPos(70, 60);
-			u8g.print(settings.max_temp, 1);
-			}
-			else{
-				u8g.drawStr(0, 12 + 16 * (selection-4), ">"); // mark selection
-				u8g.drawStr(6, 12, "Time to Max");
-				u8g.setPrintPos(100, 12);
-				u8g.print(settings.time_to_max, 0);
-				u8g.drawStr(6, 28, "Reset defaults");
-				u8g.drawStr(6, 44, "Save & exit");
-				u8g.drawStr(6, 60, "Cancel & exit");
+			unsigned char page = selection & ~0x03;
+			u8g.drawStr(0, 12 + 16 * (selection - page), ">"); // mark selection
+			for (unsigned char row = 0; row < 4; row++)
+			{
+				draw_setting(page + row, 12 + 16 * row);
 			}
 		} while (u8g.nextPage());
 		
@@ -501,10 +712,10 @@ void menu_edit_settings()
 
 			// act on the selection (return to main or reset...)
 			switch(selection){
-				case 5: // reset default
+				case SETTINGS_ITEM_RESET: // reset default
 						settings_setdefault(&settings);
 				break;
-				case 6: // save settings and return to main
+				case SETTINGS_ITEM_SAVE: // save settings and return to main
 					if (settings_valid(&settings))
 					{
 						settings_save(&settings); // save to eeprom
@@ -524,7 +735,7 @@ void menu_edit_settings()
 						_delay_ms(1000);
 					}
 					break;
-				case 7: // discard changes and return to main
+				case SETTINGS_ITEM_CANCEL: // discard changes and return to main
 					return;
 				break;
 				default:
@@ -542,9 +753,11 @@ void menu_edit_settings()
 			case 0: // selecting which value to edit
 				selection = (RotEnc.read() / ROTENC_PPS);
 				if(selection>254){ 		// underflow
-				RotEnc.write(7*ROTENC_PPS); 
-				}else if (selection>7){ // overflow
+				RotEnc.write((SETTINGS_ITEMS - 1)*ROTENC_PPS);
+				selection = SETTINGS_ITEMS - 1;
+				}else if (selection>SETTINGS_ITEMS - 1){ // overflow
 				RotEnc.write(0);
+				selection = 0;
 			}
 			break;
 			case 1:
@@ -566,6 +779,9 @@ void menu_edit_settings()
 			digit = 0.01;
 			break;
 			case 7:
+			digit = GAIN_STEP; // the finest a gain can be set
+			break;
+			case 8:
 			whichdigit=0; // back to selecting values
 			break;
 		}
@@ -573,21 +789,38 @@ void menu_edit_settings()
 		if(whichdigit !=0){ // only edit values when not selecting them
 		switch(selection){
 			case 0: // PID P
-				settings.pid_p = change_value_double(settings.pid_p, digit, 0.0, 10000.0);	
+				settings.pid_p = change_value_double(settings.pid_p, digit, 0.0, GAIN_LIMIT);	
 			break;
 			case 1: // PID I
-				settings.pid_i = change_value_double(settings.pid_i, digit, 0.0, 10000.0);
+				settings.pid_i = change_value_double(settings.pid_i, digit, 0.0, GAIN_LIMIT);
 			break;
 			case 2: // PID D
-				settings.pid_d = change_value_double(settings.pid_d, digit, -10000.0, 10000.0);
+				settings.pid_d = change_value_double(settings.pid_d, digit, -GAIN_LIMIT, GAIN_LIMIT);
 			break;
 			case 3:	// maximum temperature
 			settings.max_temp = change_value_double(settings.max_temp, 1.0, 200.0, 350.0);
-			whichdigit=6; // so on next press of enter, go back to selecting values
+			whichdigit=7; // so on next press of enter, go back to selecting values
 			break;
 			case 4: // time to maximum
 			settings.time_to_max = change_value_double(settings.time_to_max, 1.0, 0.0, (double) 60*20);
-			whichdigit=6; // so on next press of enter, go back to selecting values
+			whichdigit=7; // so on next press of enter, go back to selecting values
+			break;
+			case 5: // PID P at and above sched_high
+				settings.pid_p_hot = change_value_double(settings.pid_p_hot, digit, 0.0, GAIN_LIMIT);
+			break;
+			case 6: // PID I at and above sched_high
+				settings.pid_i_hot = change_value_double(settings.pid_i_hot, digit, 0.0, GAIN_LIMIT);
+			break;
+			case 7: // PID D at and above sched_high
+				settings.pid_d_hot = change_value_double(settings.pid_d_hot, digit, -GAIN_LIMIT, GAIN_LIMIT);
+			break;
+			case 8: // temperature where the gains start to blend towards the hot ones
+			settings.sched_low = change_value_double(settings.sched_low, 1.0, 0.0, settings.sched_high);
+			whichdigit=7; // so on next press of enter, go back to selecting values
+			break;
+			case 9: // temperature from which the hot gains are used
+			settings.sched_high = change_value_double(settings.sched_high, 1.0, settings.sched_low, 350.0);
+			whichdigit=7; // so on next press of enter, go back to selecting values
 			break;
 			default:
 			break;
@@ -596,26 +829,400 @@ void menu_edit_settings()
 	}
 }
 
+#if AUTOTUNE
+void menu_autotune()
+{
+	double tgt_temp = 150.0;
+	uint16_t iteration = 0;
+	int16_t cur_temp = sensor_read();
+	unsigned long prevmillis = millis();
+	autotune_t t;
+
+	heat_set(0);
+	settings_load(&settings); // load from eeprom
+	RotEnc.write(0);
+
+	// choose the temperature to tune around, best somewhere in the soak range
+	while (1)
+	{
+		if (cmd_poll() != CMD_NONE)
+		{
+			return; // remote actions are handled by the main menu
+		}
+
+		tgt_temp = change_value_double(tgt_temp, 5.0, 50.0, settings.max_temp - 20.0);
+
+		u8g.firstPage();
+		do
+		{
+			u8g.drawStr(0, 12, "Autotune at");
+			u8g.setPrintPos(0, 28);
+			u8g.print(tgt_temp, 0);
+			u8g.drawStr(30, 28, "\xb0""C");
+			u8g.drawStr(0, 60, "Press to start");
+		} while (u8g.nextPage());
+
+		if (button_enter())
+		{
+			delay(25);
+			while (button_enter())
+				;
+			delay(25);
+			RotEnc.write(0);
+			break;
+		}
+	}
+
+	sensor_filter_reset();
+	autotune_init(&t, tgt_temp);
+
+	// signal start of mode in log, the lines are the same as in manual temperature control mode
+	fprintf_P(&log_stream, PSTR("autotune mode,\n"));
+
+	while (t.state == AUTOTUNE_RUNNING)
+	{
+		switch (cmd_poll())
+		{
+		case CMD_NONE:
+			break;
+		case CMD_ABORT:
+			cmd_accept();
+			// fall through
+		default: // leave other actions pending for the main menu
+			heat_set(0);
+			return;
+		}
+
+		u8g.firstPage();
+		do
+		{
+			u8g.drawStr(0, 14, "Autotune");
+			u8g.drawStr(0, 29, str_from_deci(cur_temp));
+			u8g.drawStr(50, 29, "\xb0""C");
+			u8g.drawStr(0, 44, "Cycle");
+			u8g.setPrintPos(60, 44);
+			u8g.print(t.cycles, DEC);
+			u8g.drawStr(75, 44, "/");
+			u8g.setPrintPos(85, 44);
+			u8g.print(AUTOTUNE_SKIP + AUTOTUNE_CYCLES, DEC);
+			u8g.setPrintPos(0, 60);
+			u8g.print(t.pwm_ocr, DEC);
+		} while (u8g.nextPage());
+
+		// stop on buttonpress
+		if (button_enter())
+		{
+			heat_set(0);
+			delay(25);
+			while (button_enter())
+				;
+			delay(25);
+			RotEnc.write(0);
+			return;
+		}
+
+		if (millis() - prevmillis > 500)
+		{
+			// every half a second, same as auto_go, so the gains fit its pid() calls
+			prevmillis = millis();
+			iteration++;
+			cur_temp = sensor_read();
+			autotune_step(&t, cur_temp);
+			heat_set(t.pwm_ocr);
+			if ((iteration & 0x01) && cmd_telemetry)
+			{
+				fprintf_P(&log_stream, PSTR("%s, "), str_from_double(iteration / 2, 1));
+				fprintf_P(&log_stream, PSTR("%s, "), str_from_deci(cur_temp));
+				fprintf_P(&log_stream, PSTR("%s, "), str_from_int(tgt_temp));
+				fprintf_P(&log_stream, PSTR("%s,\n"), str_from_int(t.pwm_ocr));
+			}
+		}
+	}
+	heat_set(0);
+
+	settings_t tuned = settings;
+	char ok = autotune_result(&t, &tuned);
+	if (ok)
+	{
+		fprintf_P(&log_stream, PSTR("autotune gains, %s, "), str_from_double(tuned.pid_p, GAIN_DECIMALS));
+		fprintf_P(&log_stream, PSTR("%s, "), str_from_double(tuned.pid_i, GAIN_DECIMALS));
+		fprintf_P(&log_stream, PSTR("%s, "), str_from_double(tuned.pid_d, GAIN_DECIMALS));
+		fprintf_P(&log_stream, PSTR("%s, "), str_from_double(tuned.pid_p_hot, GAIN_DECIMALS));
+		fprintf_P(&log_stream, PSTR("%s, "), str_from_double(tuned.pid_i_hot, GAIN_DECIMALS));
+		fprintf_P(&log_stream, PSTR("%s,\n"), str_from_double(tuned.pid_d_hot, GAIN_DECIMALS));
+	}
+	else
+	{
+		fprintf_P(&log_stream, PSTR("autotune failed,\n"));
+	}
+
+	// offer to save the result
+	RotEnc.write(0);
+	while (1)
+	{
+		unsigned char selection = (RotEnc.read() / ROTENC_PPS) & 0x01;
+
+		u8g.firstPage();
+		do
+		{
+			if (ok)
+			{
+				char hot = tgt_temp >= tuned.sched_high;
+				u8g.drawStr(0, 12, hot ? "Hot P =" : "P =");
+				u8g.setPrintPos(70, 12);
+				u8g.print(hot ? tuned.pid_p_hot : tuned.pid_p, GAIN_DECIMALS);
+				u8g.drawStr(0, 28, hot ? "Hot I =" : "I =");
+				u8g.setPrintPos(70, 28);
+				u8g.print(hot ? tuned.pid_i_hot : tuned.pid_i, GAIN_DECIMALS);
+				u8g.drawStr(0, 44 + 16 * selection, ">");
+				u8g.drawStr(6, 44, "Save & exit");
+				u8g.drawStr(6, 60, "Discard & exit");
+			}
+			else
+			{
+				u8g.drawStr(0, 28, "Autotune");
+				u8g.drawStr(0, 44, "failed !");
+			}
+		} while (u8g.nextPage());
+
+		if (button_enter())
+		{
+			delay(25);
+			while (button_enter())
+				;
+			delay(25);
+			RotEnc.write(0);
+			if (ok && selection == 0)
+			{
+				settings = tuned;
+				settings_save(&settings); // save to eeprom
+			}
+			return;
+		}
+	}
+}
+#endif
+
+// the rows of the calibration menu, the reading with the calibration as it is edited, then a row per point
+#define CAL_ITEM_NOW 0
+#define CAL_ITEM_OFFSET 1
+#define CAL_ITEM_POINT 2
+#define CAL_ITEM_RESET (CAL_ITEM_POINT + CALIBRATION_POINTS)
+#define CAL_ITEM_SAVE (CAL_ITEM_RESET + 1)
+#define CAL_ITEM_CANCEL (CAL_ITEM_RESET + 2)
+#define CAL_ITEMS (CAL_ITEM_RESET + 3)
+
+static void draw_calibration(calibration_t *cal, int16_t now, unsigned char item, unsigned char y)
+{
+	if (item == CAL_ITEM_NOW)
+	{
+		u8g.drawStr(6, y, "Now\xb0""C");
+		u8g.drawStr(70, y, str_from_deci(now));
+	}
+	else if (item == CAL_ITEM_OFFSET)
+	{
+		u8g.drawStr(6, y, "Offset");
+		u8g.setPrintPos(70, y);
+		u8g.print(cal->offset / 10.0, 1);
+	}
+	else if (item < CAL_ITEM_RESET)
+	{
+		// reads as -> is
+		u8g.setPrintPos(6, y);
+		u8g.print(cal->raw[item - CAL_ITEM_POINT] / 10.0, 0);
+		u8g.drawStr(50, y, "->");
+		u8g.setPrintPos(70, y);
+		u8g.print(cal->temp[item - CAL_ITEM_POINT] / 10.0, 1);
+	}
+	else if (item == CAL_ITEM_RESET)
+	{
+		u8g.drawStr(6, y, "Reset defaults");
+	}
+	else if (item == CAL_ITEM_SAVE)
+	{
+		u8g.drawStr(6, y, "Save & exit");
+	}
+	else if (item == CAL_ITEM_CANCEL)
+	{
+		u8g.drawStr(6, y, "Cancel & exit");
+	}
+}
+
+// compare the reading with a reference thermometer and set what it really is at the points around it
+void menu_calibrate()
+{
+	calibration_t cal;
+	unsigned char selection = 0;
+	unsigned char field = 0; // 0 selects a row, 1 and 2 edit the reading and the temperature of a point, 1 the offset
+	static const unsigned char field_x[] = {6, 70};
+	calibration_load(&cal);
+	fprintf_P(&log_stream, PSTR("Calibration Menu,\n"));
+
+	while (1)
+	{
+		heat_set(0); // turn off for safety
+		if (calibration_valid(&cal))
+		{
+			sensor_calibrate(&cal); // so the reading shows the edits
+		}
+		int16_t now = sensor_read(); // once per frame, not per page
+
+		// u8glib picture loop
+		u8g.firstPage();
+		do
+		{
+			unsigned char page = selection & ~0x03;
+			u8g.drawStr(0, 12 + 16 * (selection - page), ">"); // mark selection
+			for (unsigned char row = 0; row < 4; row++)
+			{
+				draw_calibration(&cal, now, page + row, 12 + 16 * row);
+			}
+			if (field != 0)
+			{
+				u8g.drawHLine(field_x[selection == CAL_ITEM_OFFSET ? 1 : field - 1], 14 + 16 * (selection - page), 40); // underline what is edited
+			}
+		} while (u8g.nextPage());
+
+		if (button_enter())
+		{
+			delay(25);
+			while (button_enter())
+				;
+			delay(25);
+			RotEnc.write(0); // reset rotary encoder before entering next mode...
+
+			if (selection == CAL_ITEM_RESET)
+			{
+				calibration_setdefault(&cal);
+			}
+			else if (selection == CAL_ITEM_SAVE)
+			{
+				if (calibration_valid(&cal))
+				{
+					calibration_save(&cal); // save to eeprom
+					return;
+				}
+				u8g.firstPage();
+				do
+				{
+					u8g.drawStr(0, 12, "Points have");
+					u8g.drawStr(0, 28, "to rise, please");
+					u8g.drawStr(0, 44, "Review & fix");
+				} while (u8g.nextPage());
+				_delay_ms(1000);
+			}
+			else if (selection == CAL_ITEM_CANCEL)
+			{
+				calibration_load(&cal); // discard the changes
+				sensor_calibrate(&cal);
+				return;
+			}
+			else if (selection != CAL_ITEM_NOW)
+			{
+				field++;
+				if (field > (selection == CAL_ITEM_OFFSET ? 1 : 2))
+				{
+					field = 0;
+				}
+			}
+			RotEnc.write(selection * ROTENC_PPS); // stay on this row
+		}
+
+		if (field == 0)
+		{
+			selection = (RotEnc.read() / ROTENC_PPS);
+			if (selection > 254)
+			{ // underflow
+				RotEnc.write((CAL_ITEMS - 1) * ROTENC_PPS);
+				selection = CAL_ITEMS - 1;
+			}
+			else if (selection > CAL_ITEMS - 1)
+			{ // overflow
+				RotEnc.write(0);
+				selection = 0;
+			}
+		}
+		else if (selection == CAL_ITEM_OFFSET)
+		{
+			cal.offset = change_value_int(cal.offset, 1, -200, 200); // 0.1 C steps
+		}
+		else if (field == 1)
+		{
+			cal.raw[selection - CAL_ITEM_POINT] = change_value_int(cal.raw[selection - CAL_ITEM_POINT], 10, 0, CALIBRATION_MAX); // 1 C steps
+		}
+		else
+		{
+			cal.temp[selection - CAL_ITEM_POINT] = change_value_int(cal.temp[selection - CAL_ITEM_POINT], 1, 0, CALIBRATION_MAX); // 0.1 C steps
+		}
+	}
+}
+
+#define MAIN_ITEMS (5 + AUTOTUNE) // Auto Reflow .. Edit Settings, then PID Autotune and Calibrate on the second page
 
 void main_menu() // main menu is also main loop.
 {
 	unsigned char selection = 0;
+	static profile_t remote_profile; // profile for runs started over the serial port
 	fprintf_P(&log_stream, PSTR("Main Menu,\n"));
 
 	while (1)
 	{
 		heat_set(0); // turn off for safety
-		selection = (RotEnc.read() / ROTENC_PPS) & 0x03; // only allow 0,1,2,3 - mask instead of modulo so it wont go negative either.
+
+		// remote control over the serial port
+		switch (cmd_poll())
+		{
+		case CMD_START:
+			cmd_accept();
+			RotEnc.write(0);
+			profile_load(&remote_profile); // load from eeprom
+			auto_go(&remote_profile);
+			break;
+		case CMD_TEMP:
+			menu_manual_temp_ctrl(); // picks up the setpoint itself
+			break;
+		case CMD_PWM:
+			menu_manual_pwm_ctrl(); // picks up the duty cycle itself
+			break;
+		case CMD_ABORT:
+			cmd_accept(); // nothing running
+			break;
+		default:
+			break;
+		}
+
+		selection = (RotEnc.read() / ROTENC_PPS);
+		if (selection > 254)
+		{ // underflow
+			RotEnc.write((MAIN_ITEMS - 1) * ROTENC_PPS);
+			selection = MAIN_ITEMS - 1;
+		}
+		else if (selection > MAIN_ITEMS - 1)
+		{ // overflow
+			RotEnc.write(0);
+			selection = 0;
+		}
 
 		// u8glib picture loop
 		u8g.firstPage();
 		do
 		{
-			u8g.drawStr(0, 12 + 16 * selection, ">"); // mark selection (font heigt * selection modulo number of items, distance, marker) TODO: use font height and width read from font setting if possible
-			u8g.drawStr(6, 12, "Auto Reflow");
-			u8g.drawStr(6, 28, "Set Temperature");
-			u8g.drawStr(6, 44, "Set PWM");
-			u8g.drawStr(6, 60, "Edit Settings");
+			if (selection < 4)
+			{
+				u8g.drawStr(0, 12 + 16 * selection, ">"); // mark selection (font heigt * selection modulo number of items, distance, marker) TODO: use font height and width read from font setting if possible
+				u8g.drawStr(6, 12, "Auto Reflow");
+				u8g.drawStr(6, 28, "Set Temperature");
+				u8g.drawStr(6, 44, "Set PWM");
+				u8g.drawStr(6, 60, "Edit Settings");
+			}
+			else
+			{
+				u8g.drawStr(0, 12 + 16 * (selection - 4), ">"); // second page
+#if AUTOTUNE
+				u8g.drawStr(6, 12, "PID Autotune");
+#endif
+				u8g.drawStr(6, 12 + 16 * AUTOTUNE, "Calibrate");
+			}
 		} while (u8g.nextPage());
 	
 		if (button_enter())
@@ -644,6 +1251,16 @@ void main_menu() // main menu is also main loop.
 			{
 				menu_edit_settings();
 			}
+#if AUTOTUNE
+			else if (selection == 4)
+			{
+				menu_autotune();
+			}
+#endif
+			else if (selection == 4 + AUTOTUNE)
+			{
+				menu_calibrate();
+			}
 		}
 	}
 }
\ No newline at end of file
@@ -26,80 +26,602 @@
  * functions to load/save from/to EEPROM
  * things like profiles and settings
  *
+ * Every block is a record:
+ *   uint8_t  NVM_MAGIC
+ *   uint8_t  version of the layout of the data, see nvm.h
+ *   uint8_t  length of the data
+ *   data
+ *   uint16_t CRC-16 (CCITT) of all of the above
+ * Fields are only ever added at the end of a struct. A shorter record from older firmware is read
+ * as far as it goes and the rest keeps its default, a longer one from newer firmware is cut short.
+ * The XOR checksummed blocks of older firmware are migrated on the first settings_load().
+ *
+ * Writing an EEPROM byte takes 3.4 ms, so nothing waits for it. nvm_write() puts the bytes in a queue
+ * and the EEPROM ready interrupt writes them one by one, skipping the ones that did not change. A write
+ * to the same place as one that is still waiting replaces it. Everything else in the firmware reads
+ * through nvm_read_byte(), which sees the queued bytes and keeps the interrupt from moving EEAR under it.
+ *
+ * Only what changes on its own, the run counter and the selected slot (nvm_state_t), rotates through the
+ * state ring to spread the wear. Settings, profiles, the directory and the calibration stay at fixed
+ * addresses and are rewritten in place when they are saved, which only happens when they are edited, and
+ * only the bytes that changed are written.
  */
 
 #include "reflowtoasteroven.h"
 #include "nvm.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
 #include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <stddef.h>
+#include <string.h>
+
+#define NVM_MAGIC 0x5A
+#define NVM_OVERHEAD 5 // header and CRC
+
+static_assert(sizeof(settings_t) + NVM_OVERHEAD <= EEPROM_SETTINGS_SIZE, "settings do not fit");
+static_assert(sizeof(profile_dir_t) + NVM_OVERHEAD <= EEPROM_PROFILE_DIR_SIZE, "profile directory does not fit");
+static_assert(sizeof(profile_t) + NVM_OVERHEAD <= EEPROM_PROFILE_SLOT_SIZE, "profile does not fit");
+static_assert(sizeof(calibration_t) + NVM_OVERHEAD <= EEPROM_CALIBRATION_SIZE, "calibration does not fit");
+
+// the queue holds entries of a 2 byte address, a length and the data
+#define QUEUE_HEADER 3
+
+static uint8_t queue[NVM_QUEUE_SIZE];
+static volatile uint8_t queue_len;	 // bytes in use
+static volatile uint8_t queue_head;	 // entry the interrupt is working on
+static volatile uint8_t queue_index; // next byte of that entry
+
+static nvm_state_t state;
+static uint8_t state_entry = 0xFF; // where the state was last saved, 0xFF until it has been loaded
+
+ISR(EE_READY_vect)
+{
+	while (queue_head < queue_len)
+	{
+		uint8_t* entry = &queue[queue_head];
+		if (queue_index < entry[2])
+		{
+			uint8_t data = entry[QUEUE_HEADER + queue_index];
+			EEAR = (entry[0] | (entry[1] << 8)) + queue_index++;
+			EECR |= _BV(EERE);
+			if (EEDR != data)
+			{
+				EEDR = data;
+				EECR |= _BV(EEMPE);
+				EECR |= _BV(EEPE); // the interrupt comes back once this byte is written
+				return;
+			}
+		}
+		else
+		{
+			queue_head += QUEUE_HEADER + entry[2];
+			queue_index = 0;
+		}
+	}
+	queue_len = 0;
+	queue_head = 0;
+	EECR &= ~_BV(EERIE);
+}
+
+// keeps the interrupt away from EEAR and waits for the byte it is writing
+static void queue_pause()
+{
+	EECR &= ~_BV(EERIE);
+	eeprom_busy_wait();
+}
+
+static void queue_resume()
+{
+	__asm__ __volatile__("" ::: "memory"); // the queue is complete before the interrupt can see it
+	if (queue_len != 0)
+	{
+		EECR |= _BV(EERIE);
+	}
+}
+
+char nvm_busy()
+{
+	return queue_len != 0;
+}
+
+// a waiting entry for exactly these bytes, that the interrupt has not started on, so it can still be replaced
+static uint8_t* queue_find(uint8_t* addr, uint8_t size)
+{
+	uint8_t i = queue_head;
+	if (i < queue_len && queue_index != 0)
+	{
+		i += QUEUE_HEADER + queue[i + 2];
+	}
+	for (; i < queue_len; i += QUEUE_HEADER + queue[i + 2])
+	{
+		if ((uint8_t*)(uintptr_t)(queue[i] | (queue[i + 1] << 8)) == addr && queue[i + 2] == size)
+		{
+			return &queue[i];
+		}
+	}
+	return 0;
+}
+
+void nvm_write(uint8_t* addr, const void* data, uint8_t size)
+{
+	queue_pause();
+	uint8_t* entry = queue_find(addr, size);
+	if (entry == 0)
+	{
+		if (queue_head != 0)
+		{
+			// drop what has been written
+			memmove(queue, &queue[queue_head], queue_len - queue_head);
+			queue_len -= queue_head;
+			queue_head = 0;
+		}
+		while (queue_len + QUEUE_HEADER + size > NVM_QUEUE_SIZE)
+		{
+			// full, only happens if a lot is saved at once, wait for the interrupt to empty it
+			queue_resume();
+			while (queue_len != 0)
+			{
+			}
+			queue_pause();
+		}
+		entry = &queue[queue_len];
+		entry[0] = (uintptr_t)addr & 0xFF;
+		entry[1] = (uintptr_t)addr >> 8;
+		entry[2] = size;
+		queue_len += QUEUE_HEADER + size;
+	}
+	memcpy(entry + QUEUE_HEADER, data, size);
+	queue_resume();
+}
+
+uint8_t nvm_read_byte(const uint8_t* addr)
+{
+	queue_pause();
+	uint8_t data = eeprom_read_byte(addr);
+	// the last queued write of this byte is what it is going to be
+	for (uint8_t i = queue_head; i < queue_len; i += QUEUE_HEADER + queue[i + 2])
+	{
+		uint16_t offset = addr - (uint8_t*)(uintptr_t)(queue[i] | (queue[i + 1] << 8));
+		if (offset < queue[i + 2])
+		{
+			data = queue[i + QUEUE_HEADER + offset];
+		}
+	}
+	queue_resume();
+	return data;
+}
+
+// reads a record over the data, returns how many bytes of it were read, 0 if there is no valid record
+// the data can be partly overwritten even if the record is not valid
+static uint8_t record_read(uint8_t* addr, uint8_t* version, void* data, uint8_t size)
+{
+	uint16_t crc = 0xFFFF;
+	uint8_t header[3];
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		header[i] = nvm_read_byte(addr + i);
+		crc = _crc_ccitt_update(crc, header[i]);
+	}
+	uint8_t length = header[2];
+	if (header[0] != NVM_MAGIC || length == 0)
+	{
+		return 0;
+	}
+
+	uint8_t* ptr = (uint8_t*)data;
+	for (uint8_t i = 0; i < length; i++)
+	{
+		uint8_t j = nvm_read_byte(addr + 3 + i);
+		if (i < size)
+		{
+			ptr[i] = j;
+		}
+		crc = _crc_ccitt_update(crc, j);
+	}
+	if ((nvm_read_byte(addr + 3 + length) | (nvm_read_byte(addr + 4 + length) << 8)) != crc)
+	{
+		return 0;
+	}
+	*version = header[1];
+	return length < size ? length : size;
+}
+
+// the whole record goes into the queue as one entry, so a later save of it replaces it while it waits
+static void record_write(uint8_t* addr, uint8_t version, const void* data, uint8_t size)
+{
+	uint8_t record[EEPROM_SETTINGS_SIZE]; // the biggest place a record can have
+	record[0] = NVM_MAGIC;
+	record[1] = version;
+	record[2] = size;
+	memcpy(&record[3], data, size);
+	uint16_t crc = 0xFFFF;
+	for (uint8_t i = 0; i < size + 3; i++)
+	{
+		crc = _crc_ccitt_update(crc, record[i]);
+	}
+	record[size + 3] = crc & 0xFF;
+	record[size + 4] = crc >> 8;
+	nvm_write(addr, record, size + NVM_OVERHEAD);
+}
+
+// the newest entry of the ring is the one the next entry does not follow on from
+// an entry cut short by a power loss fails its CRC, so the one before it is used
+static void state_load()
+{
+	uint8_t seq[NVM_STATE_ENTRIES];
+	uint8_t valid = 0;
+	for (uint8_t i = 0; i < NVM_STATE_ENTRIES; i++)
+	{
+		uint8_t* addr = EEPROM_STATE_ADDR + i * EEPROM_STATE_ENTRY_SIZE;
+		uint16_t crc = 0xFFFF;
+		for (uint8_t j = 0; j < EEPROM_STATE_ENTRY_SIZE - 2; j++)
+		{
+			crc = _crc_ccitt_update(crc, nvm_read_byte(addr + j));
+		}
+		seq[i] = nvm_read_byte(addr);
+		if ((nvm_read_byte(addr + EEPROM_STATE_ENTRY_SIZE - 2) | (nvm_read_byte(addr + EEPROM_STATE_ENTRY_SIZE - 1) << 8)) == crc)
+		{
+			valid |= 1 << i;
+		}
+	}
+
+	state_entry = NVM_STATE_ENTRIES - 1; // so the first save goes to entry 0
+	state.runs = 0;
+	state.selected = 0xFF;
+	for (uint8_t i = 0; i < NVM_STATE_ENTRIES; i++)
+	{
+		uint8_t next = (i + 1) % NVM_STATE_ENTRIES;
+		if (((valid >> i) & 1) && (!((valid >> next) & 1) || seq[next] != (uint8_t)(seq[i] + 1)))
+		{
+			state_entry = i;
+			for (uint8_t j = 0; j < sizeof(nvm_state_t); j++)
+			{
+				((uint8_t*)&state)[j] = nvm_read_byte(EEPROM_STATE_ADDR + i * EEPROM_STATE_ENTRY_SIZE + 1 + j);
+			}
+			break;
+		}
+	}
+}
+
+static nvm_state_t* state_get()
+{
+	if (state_entry == 0xFF)
+	{
+		state_load();
+	}
+	return &state;
+}
+
+// the next entry of the ring, or the queued one again while it still waits
+static void state_save()
+{
+	uint8_t entry[EEPROM_STATE_ENTRY_SIZE];
+	uint8_t* addr = EEPROM_STATE_ADDR + state_entry * EEPROM_STATE_ENTRY_SIZE;
+	uint8_t seq = nvm_read_byte(addr);
+	if (!queue_find(addr, EEPROM_STATE_ENTRY_SIZE))
+	{
+		state_entry = (state_entry + 1) % NVM_STATE_ENTRIES;
+		addr = EEPROM_STATE_ADDR + state_entry * EEPROM_STATE_ENTRY_SIZE;
+		seq++;
+	}
+	entry[0] = seq;
+	memcpy(&entry[1], &state, sizeof(nvm_state_t));
+	uint16_t crc = 0xFFFF;
+	for (uint8_t i = 0; i < EEPROM_STATE_ENTRY_SIZE - 2; i++)
+	{
+		crc = _crc_ccitt_update(crc, entry[i]);
+	}
+	entry[EEPROM_STATE_ENTRY_SIZE - 2] = crc & 0xFF;
+	entry[EEPROM_STATE_ENTRY_SIZE - 1] = crc >> 8;
+	nvm_write(addr, entry, EEPROM_STATE_ENTRY_SIZE);
+}
+
+uint16_t nvm_runs()
+{
+	return state_get()->runs;
+}
+
+void nvm_count_run()
+{
+	state_get()->runs++;
+	state_save();
+}
+
+// the settings of firmware without the gain schedule, which is the same gains everywhere
+static void settings_fill(settings_t* s, uint8_t length)
+{
+	if (length <= offsetof(settings_t, pid_p_hot))
+	{
+		s->pid_p_hot = s->pid_p;
+		s->pid_i_hot = s->pid_i;
+		s->pid_d_hot = s->pid_d;
+	}
+}
+
+// firmware before settings version 2 worked in AD595 counts instead of 0.1 C, so its gains were per count
+static void settings_from_counts(settings_t* s)
+{
+	const double counts_per_deci = 1.0 / (THERMOCOUPLE_CONSTANT * 10.0);
+	s->pid_p *= counts_per_deci;
+	s->pid_i *= counts_per_deci;
+	s->pid_d *= counts_per_deci;
+	s->pid_p_hot *= counts_per_deci;
+	s->pid_i_hot *= counts_per_deci;
+	s->pid_d_hot *= counts_per_deci;
+}
+
+static double gain_clamp(double gain, double min)
+{
+	return gain < min ? min : (gain > GAIN_LIMIT ? GAIN_LIMIT : gain);
+}
+
+// firmware before GAIN_LIMIT took any gain and pid() clamped it, keep such gains as close as they can be
+// returns 1 if one had to be changed
+static char settings_clamp(settings_t* s)
+{
+	settings_t before = *s;
+	s->pid_p = gain_clamp(s->pid_p, 0.0);
+	s->pid_i = gain_clamp(s->pid_i, 0.0);
+	s->pid_d = gain_clamp(s->pid_d, -GAIN_LIMIT);
+	s->pid_p_hot = gain_clamp(s->pid_p_hot, 0.0);
+	s->pid_i_hot = gain_clamp(s->pid_i_hot, 0.0);
+	s->pid_d_hot = gain_clamp(s->pid_d_hot, -GAIN_LIMIT);
+	return memcmp(&before, s, sizeof(settings_t)) != 0;
+}
+
+static void profile_dir_default(profile_dir_t* dir)
+{
+	char name[PROFILE_NAME_SIZE] = "Profile 1";
+	dir->selected = 0;
+	dir->valid = 0;
+	for (uint8_t slot = 0; slot < PROFILE_SLOTS; slot++)
+	{
+		name[8] = '1' + slot;
+		memcpy(dir->name[slot], name, PROFILE_NAME_SIZE);
+	}
+}
+
+static void profile_dir_load(profile_dir_t* dir)
+{
+	uint8_t version;
+	if (record_read(EEPROM_PROFILE_DIR_ADDR, &version, dir, sizeof(profile_dir_t)) != sizeof(profile_dir_t) ||
+		version != PROFILE_DIR_VERSION || dir->selected >= PROFILE_SLOTS)
+	{
+		profile_dir_default(dir);
+		record_write(EEPROM_PROFILE_DIR_ADDR, PROFILE_DIR_VERSION, dir, sizeof(profile_dir_t));
+	}
+}
+
+static void profile_dir_save(profile_dir_t* dir)
+{
+	record_write(EEPROM_PROFILE_DIR_ADDR, PROFILE_DIR_VERSION, dir, sizeof(profile_dir_t));
+}
+
+static void profile_slot_save(uint8_t slot, profile_t* profile)
+{
+	record_write(EEPROM_PROFILE_ADDR + slot * EEPROM_PROFILE_SLOT_SIZE, PROFILE_VERSION, profile, sizeof(profile_t));
+
+	profile_dir_t dir;
+	profile_dir_load(&dir);
+	dir.valid |= 1 << slot;
+	profile_dir_save(&dir);
+}
+
+// firmware before the records kept the settings (5 floats, 10 since the gain schedule) at 0 followed by their XOR
+// checksum, and the profile of fixed stages 2 bytes after the settings, also followed by its XOR checksum
+#define LEGACY_SETTINGS_SIZE 20
+#define LEGACY_SCHEDULE_SIZE 40
+
+typedef struct __attribute__((packed)) // as the AVR laid it out
+{
+	float start_rate;
+	float soak_temp1;
+	float soak_temp2;
+	uint16_t soak_length;
+	float peak_temp;
+	uint16_t time_to_peak;
+	float cool_rate;
+} legacy_profile_t;
+
+static char legacy_read(uint8_t* addr, void* data, uint8_t size)
+{
+	uint8_t* ptr = (uint8_t*)data;
+	uint8_t checksum = 0;
+	for (uint8_t i = 0; i < size; i++)
+	{
+		ptr[i] = nvm_read_byte(addr + i);
+		checksum ^= ptr[i];
+	}
+	return checksum == nvm_read_byte(addr + size);
+}
+
+// reads old settings of this size, in the current units, returns 0 if they are not valid
+static char legacy_settings(settings_t* s, uint8_t size)
+{
+	settings_setdefault(s);
+	if (!legacy_read(EEPROM_SETTINGS_ADDR, s, size))
+	{
+		return 0;
+	}
+	settings_fill(s, size);
+	settings_from_counts(s);
+	settings_clamp(s);
+	return settings_valid(s);
+}
+
+// turns the XOR checksummed blocks into records, so tuned gains survive the update
+static void legacy_migrate(settings_t* s)
+{
+	uint8_t size = LEGACY_SCHEDULE_SIZE;
+	if (!legacy_settings(s, size))
+	{
+		size = LEGACY_SETTINGS_SIZE;
+		if (!legacy_settings(s, size))
+		{
+			settings_setdefault(s);
+		}
+	}
+
+	profile_t profile;
+	legacy_profile_t old;
+	profile_setdefault(&profile);
+	if (legacy_read(EEPROM_SETTINGS_ADDR + 2 + size, &old, sizeof(legacy_profile_t)) && old.time_to_peak > 0)
+	{
+		profile_stages(&profile, old.start_rate, old.soak_temp1, old.soak_temp2, old.soak_length, old.peak_temp, old.time_to_peak, old.cool_rate);
+		if (!profile_valid(&profile))
+		{
+			profile_setdefault(&profile);
+		}
+	}
+
+	// the records overwrite the old blocks, everything has been read by now
+	profile_dir_t dir;
+	profile_dir_default(&dir);
+	profile_dir_save(&dir);
+	profile_slot_save(0, &profile);
+	settings_save(s);
+}
+
+uint8_t profile_selected()
+{
+	uint8_t slot = state_get()->selected;
+	if (slot >= PROFILE_SLOTS)
+	{
+		// nothing in the ring yet, the directory had it before
+		profile_dir_t dir;
+		profile_dir_load(&dir);
+		slot = dir.selected;
+	}
+	return slot;
+}
+
+void profile_select(uint8_t slot)
+{
+	if (slot != profile_selected())
+	{
+		state.selected = slot < PROFILE_SLOTS ? slot : 0;
+		state_save();
+	}
+}
+
+char profile_slot_valid(uint8_t slot)
+{
+	profile_dir_t dir;
+	profile_dir_load(&dir);
+	return (dir.valid >> slot) & 1;
+}
+
+void profile_name(uint8_t slot, char* name)
+{
+	profile_dir_t dir;
+	profile_dir_load(&dir);
+	memcpy(name, dir.name[slot], PROFILE_NAME_SIZE);
+	name[PROFILE_NAME_SIZE] = 0;
+}
+
+void profile_rename(uint8_t slot, const char* name)
+{
+	profile_dir_t dir;
+	profile_dir_load(&dir);
+	strncpy(dir.name[slot], name, PROFILE_NAME_SIZE); // pads with 0
+	profile_dir_save(&dir);
+}
 
 void profile_load(profile_t* profile)
 {
-	// load the data block from EEPROM
-	uint8_t* ptr = (uint8_t*)profile;
-	uint8_t i = 0, checksum = 0;
-	for (i = 0; i < sizeof(profile_t); i++)
+	// only the selected slot is read
+	uint8_t slot = profile_selected();
+	profile_dir_t dir;
+	profile_dir_load(&dir);
+
+	uint8_t version;
+	profile_setdefault(profile); // a shorter record leaves the rest of the segments unused
+	uint8_t length = record_read(EEPROM_PROFILE_ADDR + slot * EEPROM_PROFILE_SLOT_SIZE, &version, profile, sizeof(profile_t));
+	if (length == 0 || version != PROFILE_VERSION || !((dir.valid >> slot) & 1))
+	{
+		length = 0;
+	}
+	else if (length < sizeof(profile_t))
 	{
-		uint8_t j = eeprom_read_byte(EEPROM_PROFILE_ADDR + i);
-		ptr[i] = j;
-		checksum ^= j; // track checksum to verify later
+		// fewer segments, the default ones after them are not part of the profile
+		for (uint8_t i = length / sizeof(segment_t); i < PROFILE_SEGMENTS; i++)
+		{
+			profile->seg[i].type = SEGMENT_END;
+		}
 	}
-	
-	// verify data validity
-	uint8_t k = eeprom_read_byte(EEPROM_PROFILE_ADDR + i);
-	if (checksum != k || !profile_valid(profile))
+
+	if (length == 0 || !profile_valid(profile))
 	{
 		// data not valid, reset to defaults
 		profile_setdefault(profile);
-		profile_save(profile);
+		profile_slot_save(slot, profile);
+	}
+	else if (length < sizeof(profile_t))
+	{
+		profile_slot_save(slot, profile); // in the current layout
 	}
 }
 
 void profile_save(profile_t* profile)
 {
-	// save the data block into EEPROM
-	uint8_t* ptr = (uint8_t*)profile;
-	uint8_t i = 0, checksum = 0;
-	for (i = 0; i < sizeof(profile_t); i++)
-	{
-		uint8_t j = ptr[i];
-		eeprom_update_byte(EEPROM_PROFILE_ADDR + i, j);
-		checksum ^= j; // track checksum to save
-	}
-	eeprom_update_byte(EEPROM_PROFILE_ADDR + i, checksum); // save the checksum for validation during load
+	profile_slot_save(profile_selected(), profile);
 }
 
 void settings_load(settings_t* s)
 {
-	// load the data block from EEPROM
-	uint8_t* ptr = (uint8_t*)s;
-	uint8_t i = 0, checksum = 0;
-	for (i = 0; i < sizeof(settings_t); i++)
+	uint8_t version;
+	settings_setdefault(s); // for fields older firmware did not have
+	uint8_t length = record_read(EEPROM_SETTINGS_ADDR, &version, s, sizeof(settings_t));
+	profile_dir_t dir;
+	if (length == 0 && nvm_read_byte(EEPROM_SETTINGS_ADDR) != NVM_MAGIC &&
+		record_read(EEPROM_PROFILE_DIR_ADDR, &version, &dir, sizeof(profile_dir_t)) == 0)
+	{
+		// no records at all, first start after an update from the XOR checksums
+		legacy_migrate(s);
+		return;
+	}
+	settings_fill(s, length);
+
+	char changed = 0;
+	if (length != 0 && version != 0 && version < SETTINGS_VERSION)
 	{
-		uint8_t j = eeprom_read_byte(EEPROM_SETTINGS_ADDR + i);
-		ptr[i] = j;
-		checksum ^= j;
+		settings_from_counts(s);
+		changed = 1; // save in the current units
 	}
-	
-	// verify data validity
-	uint8_t k = eeprom_read_byte(EEPROM_SETTINGS_ADDR + i);
-	if (checksum != k || !settings_valid(s))
+	changed |= settings_clamp(s);
+
+	if (length == 0 || version == 0 || version > SETTINGS_VERSION || !settings_valid(s))
 	{
 		// data not valid, reset to defaults
 		settings_setdefault(s);
 		settings_save(s);
 	}
+	else if (changed || length < sizeof(settings_t))
+	{
+		settings_save(s); // in the current layout, with the new fields at their defaults
+	}
 }
 
 void settings_save(settings_t* s)
 {
-	// save the data block into EEPROM
-	uint8_t* ptr = (uint8_t*)s;
-	uint8_t i = 0, checksum = 0;
-	for (i = 0; i < sizeof(settings_t); i++)
+	record_write(EEPROM_SETTINGS_ADDR, SETTINGS_VERSION, s, sizeof(settings_t));
+}
+
+void calibration_load(calibration_t* cal)
+{
+	uint8_t version;
+	calibration_setdefault(cal);
+	uint8_t length = record_read(EEPROM_CALIBRATION_ADDR, &version, cal, sizeof(calibration_t));
+	if (length != sizeof(calibration_t) || version != CALIBRATION_VERSION || !calibration_valid(cal))
 	{
-		uint8_t j = ptr[i];
-		eeprom_update_byte(EEPROM_SETTINGS_ADDR + i, j);
-		checksum ^= j; // track checksum to save
+		// not calibrated yet, or not valid, the curve of the converter
+		calibration_setdefault(cal);
+		calibration_save(cal);
 	}
-	eeprom_update_byte(EEPROM_SETTINGS_ADDR + i, checksum); // save the checksum for validation during load
-}
\ No newline at end of file
+}
+
+void calibration_save(calibration_t* cal)
+{
+	record_write(EEPROM_CALIBRATION_ADDR, CALIBRATION_VERSION, cal, sizeof(calibration_t));
+}
@@ -0,0 +1,225 @@
+/* Run recorder
+ *
+ * Keeps the temperature and setpoint trace of the last automatic run in EEPROM, so there is
+ * post-mortem data even if no PC was logging. Dump it with the "dump" serial command and
+ * decode it with tools/recdecode.py.
+ *
+ * Layout, starting at EEPROM_RECORDER_ADDR:
+ *   uint8_t  magic (REC_MAGIC)
+ *   uint8_t  interval, in temperature checks per sample
+ *   uint16_t tick length in milliseconds
+ *   uint16_t stage_start[REC_STAGES], sample index at which each stage started, 0xFFFF if never reached
+ *   nibble stream, high nibble first, two values per sample: temperature then setpoint, in 0.5 C (REC_SCALE)
+ *
+ * Every value is the 4 bit two's complement difference to the previous value of the same kind (-7 to 7),
+ * or REC_ESCAPE followed by the absolute value in 3 nibbles if it changed more than that.
+ * The stream ends with an escaped REC_END, which is rewritten a little further on after every sample,
+ * so a recording that was cut short by a power loss is still readable. Not if the power goes in the few
+ * milliseconds the EEPROM takes to write a sample: the sample overwrites the old end marker before the new
+ * one is complete, it can not be the other way around as the two overlap if both values took one nibble.
+ * The stream then reads on into what an earlier recording left, recdecode.py warns about that.
+ *
+ * A sample is put together in RAM and queued as whole bytes through the nvm.cpp queue, so sampling does not wait
+ * for the EEPROM. Only bytes that change are written, so most EEPROM cells are written a few times per run.
+ */
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <stdio.h>
+
+#include "reflowtoasteroven.h"
+#include "recorder.h"
+#include "nvm.h"
+
+#if RUN_RECORDER
+
+#define REC_HEADER_SIZE (4 + 2 * REC_STAGES)
+#define REC_DATA_ADDR (EEPROM_RECORDER_ADDR + REC_HEADER_SIZE)
+#define REC_CAPACITY ((uint16_t)(EEPROM_RECORDER_END - REC_DATA_ADDR) * 2) // in nibbles
+#define REC_SAMPLE_MAX 8													// nibbles a sample can take, if both values are escaped
+
+static uint16_t rec_pos;		 // position of the next nibble
+static uint16_t rec_samples;	 // number of samples recorded
+static uint16_t rec_last[2];	 // previous temperature and setpoint value
+static uint8_t rec_tick;		 // counts temperature checks between samples
+static char rec_stage;			 // stage of the previous sample
+static char rec_active = 0;
+
+// the bytes of the stream a sample and the end marker after it can take, built here and queued as a whole,
+// starting with the byte the previous sample ended in, so a half filled byte is never read back from EEPROM
+static uint8_t rec_buffer[(1 + REC_SAMPLE_MAX + 4 + 1) / 2];
+static uint16_t rec_buffer_addr; // byte of the stream rec_buffer[0] goes to
+
+static void rec_write_nibble(uint16_t pos, uint8_t nibble)
+{
+	uint8_t *b = &rec_buffer[pos / 2 - rec_buffer_addr];
+
+	if (pos & 1)
+	{
+		*b = (*b & 0xF0) | nibble;
+	}
+	else
+	{
+		*b = (*b & 0x0F) | (nibble << 4);
+	}
+}
+
+static uint8_t rec_read_nibble(uint16_t pos)
+{
+	uint8_t b = nvm_read_byte(REC_DATA_ADDR + pos / 2);
+	return (pos & 1) ? (b & 0x0F) : (b >> 4);
+}
+
+// write an escaped absolute value at pos, returns the position after it
+static uint16_t rec_write_absolute(uint16_t pos, uint16_t value)
+{
+	rec_write_nibble(pos++, REC_ESCAPE);
+	rec_write_nibble(pos++, (value >> 8) & 0x0F);
+	rec_write_nibble(pos++, (value >> 4) & 0x0F);
+	rec_write_nibble(pos++, value & 0x0F);
+	return pos;
+}
+
+// queues the sample with the end marker after it, the interrupt skips the bytes that did not change
+static void rec_flush()
+{
+	uint16_t end = rec_write_absolute(rec_pos, REC_END);
+	nvm_write(REC_DATA_ADDR + rec_buffer_addr, rec_buffer, (end + 1) / 2 - rec_buffer_addr);
+	rec_buffer[0] = rec_buffer[rec_pos / 2 - rec_buffer_addr]; // the next sample starts in this byte if rec_pos is odd
+	rec_buffer_addr = rec_pos / 2;
+}
+
+static void rec_put(uint8_t which, uint16_t value)
+{
+	if (value >= REC_END)
+	{
+		value = REC_END - 1; // would be mistaken for the end marker, and does not fit anyway
+	}
+
+	int16_t delta = (int16_t)value - (int16_t)rec_last[which];
+
+	if (rec_samples != 0 && delta >= -7 && delta <= 7)
+	{
+		rec_write_nibble(rec_pos++, delta & 0x0F);
+	}
+	else
+	{
+		rec_pos = rec_write_absolute(rec_pos, value);
+	}
+	rec_last[which] = value;
+}
+
+void rec_start()
+{
+	uint8_t header[REC_HEADER_SIZE];
+	uint16_t *stage_start = (uint16_t *)&header[4];
+
+	header[0] = REC_MAGIC;
+	header[1] = REC_INTERVAL;
+	*(uint16_t *)&header[2] = (uint16_t)(TMR_OVF_TIMESPAN * 256 * 1000 + 0.5);
+	for (uint8_t i = 0; i < REC_STAGES; i++)
+	{
+		stage_start[i] = i == 0 ? 0 : 0xFFFF;
+	}
+	nvm_write(EEPROM_RECORDER_ADDR, header, REC_HEADER_SIZE);
+
+	rec_pos = 0;
+	rec_buffer_addr = 0;
+	rec_samples = 0;
+	rec_tick = 0;
+	rec_stage = 0;
+	rec_active = 1;
+	rec_flush();
+}
+
+// a negative value records as 0
+static uint16_t rec_value(int16_t temp)
+{
+	return temp > 0 ? (temp + REC_SCALE / 2) / REC_SCALE : 0;
+}
+
+void rec_sample(char stage, int16_t temp, int16_t setpoint)
+{
+	if (!rec_active)
+	{
+		return;
+	}
+
+	if (stage != rec_stage && stage < REC_STAGES)
+	{
+		// the new stage starts with the next sample, this is at most one interval late
+		rec_stage = stage;
+		nvm_write(EEPROM_RECORDER_ADDR + 4 + 2 * stage, &rec_samples, 2);
+	}
+
+	if (rec_tick != 0)
+	{
+		rec_tick = (rec_tick + 1) % REC_INTERVAL;
+		return;
+	}
+	rec_tick = 1 % REC_INTERVAL;
+
+	if (rec_pos + REC_SAMPLE_MAX + 4 > REC_CAPACITY)
+	{
+		// full, keep what we have, the end marker is already in place
+		rec_active = 0;
+		return;
+	}
+
+	rec_put(0, rec_value(temp));
+	rec_put(1, rec_value(setpoint));
+	rec_samples++;
+	rec_flush();
+
+	if (stage == REC_STAGES - 1)
+	{
+		rec_active = 0; // done, no need to record the oven sitting there
+	}
+}
+
+void rec_stop()
+{
+	rec_active = 0;
+}
+
+// print the recording as hex, only as far as the end marker so it is quick
+void rec_dump()
+{
+	uint16_t pos = 0;
+
+	if (nvm_read_byte(EEPROM_RECORDER_ADDR) == REC_MAGIC)
+	{
+		// walk the nibble stream to find the end marker
+		while (pos + 4 <= REC_CAPACITY)
+		{
+			if (rec_read_nibble(pos) != REC_ESCAPE)
+			{
+				pos++;
+				continue;
+			}
+			uint16_t value = (rec_read_nibble(pos + 1) << 8) | (rec_read_nibble(pos + 2) << 4) | rec_read_nibble(pos + 3);
+			pos += 4;
+			if (value == REC_END)
+			{
+				break;
+			}
+		}
+	}
+
+	uint16_t length = REC_HEADER_SIZE + (pos + 1) / 2;
+	for (uint16_t i = 0; i < length; i++)
+	{
+		if (i % 16 == 0)
+		{
+			if (i != 0)
+			{
+				fprintf_P(&log_stream, PSTR(",\n"));
+			}
+			fprintf_P(&log_stream, PSTR("rec, "));
+		}
+		fprintf_P(&log_stream, PSTR("%02x"), nvm_read_byte(EEPROM_RECORDER_ADDR + i));
+	}
+	fprintf_P(&log_stream, PSTR(",\n"));
+}
+
+#endif
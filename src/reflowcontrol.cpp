@@ -0,0 +1,633 @@
+/* Reflow Toaster Oven
+ * http://frank.circleofcurrent.com/reflowtoasteroven/
+ * Copyright (c) 2011 Frank Zhao
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ *
+ * This file contains the temperature controller, the reflow profile state machine and the
+ * profile and settings defaults, moved out of main.cpp so it does not depend on any hardware
+ *
+ */
+
+#include <stdint.h>
+#include <math.h>
+
+#include "reflowtoasteroven.h"
+#include "temperaturemeasurement.h"
+#include "reflowcontrol.h"
+
+// the settings in the fixed point pid() works in, converted once by pid_init()
+// gains are in GAIN_STEP PWM per 0.1 C, finer than a step of heat_set() (128) can show
+#define ERROR_MAX 4095		// 0.1 C
+typedef struct
+{
+	int32_t p, i, d;			 // at and below sched_low
+	int32_t p_hot, i_hot, d_hot; // from sched_high on
+	int32_t integral_max;		 // so i times the integral fits 32 bits
+	int16_t sched_low;			 // 0.1 C
+	int16_t sched_span;			 // 0.1 C from sched_low to sched_high
+	int16_t max_temp;			 // 0.1 C
+} pid_gains_t;
+
+static pid_gains_t gains;
+
+static int32_t gain_from_setting(double gain)
+{
+	return lround(fmin(fmax(gain * (1 << GAIN_SHIFT), -GAIN_MAX), GAIN_MAX));
+}
+
+static int16_t error_limit(int32_t error)
+{
+	return error > ERROR_MAX ? ERROR_MAX : (error < -ERROR_MAX ? -ERROR_MAX : error);
+}
+
+static int32_t integral_limit(int32_t integral)
+{
+	return integral > gains.integral_max ? gains.integral_max : (integral < -gains.integral_max ? -gains.integral_max : integral);
+}
+
+// takes the settings, call before pid() and approx_pwm() once they are loaded
+void pid_init()
+{
+	gains.p = gain_from_setting(settings.pid_p);
+	gains.i = gain_from_setting(settings.pid_i);
+	gains.d = gain_from_setting(settings.pid_d);
+	gains.p_hot = gain_from_setting(settings.pid_p_hot);
+	gains.i_hot = gain_from_setting(settings.pid_i_hot);
+	gains.d_hot = gain_from_setting(settings.pid_d_hot);
+	int32_t i_max = labs(gains.i) > labs(gains.i_hot) ? labs(gains.i) : labs(gains.i_hot);
+	gains.integral_max = 0x7FFFFFFFL / (i_max + 1);
+	gains.sched_low = temperature_to_deci(settings.sched_low);
+	gains.sched_span = temperature_to_deci(settings.sched_high) - gains.sched_low;
+	gains.max_temp = temperature_to_deci(settings.max_temp);
+	gains.max_temp = gains.max_temp > 0 ? gains.max_temp : 1;
+}
+
+// this estimates the PWM duty cycle needed to reach a certain steady temperature
+// if the toaster is capable of a maximum of 300 degrees, then 100% duty cycle is used if the target temperature is 300 degrees, and 0% duty cycle is used if the target temperature is room temperature.
+int32_t approx_pwm(int16_t target)
+{
+	return (int32_t)target * 65535 / gains.max_temp;
+}
+
+// this estimates the extra PWM duty cycle needed to make the temperature change at a rate (in C/s) the profile asks for
+// max_temp / time_to_max is the rate at which the toaster heats at 100% duty cycle, so that rate needs all of it
+// this is negative while cooling, the toaster cools by itself when it gets less than approx_pwm()
+double rate_pwm(double rate)
+{
+	return 65535.0 * rate * settings.time_to_max / settings.max_temp;
+}
+
+// picks the gains for a target from the schedule, the toaster behaves differently when hot
+static void pid_gains(int16_t target, int32_t *gain_p, int32_t *gain_i, int32_t *gain_d)
+{
+	int32_t hot; // 1/256
+	if (gains.sched_span > 0)
+	{
+		hot = ((int32_t)(target - gains.sched_low) << 8) / gains.sched_span;
+		hot = hot < 0 ? 0 : (hot > 256 ? 256 : hot);
+	}
+	else
+	{
+		hot = target > gains.sched_low ? 256 : 0;
+	}
+	(*gain_p) = gains.p + (((gains.p_hot - gains.p) * hot) >> 8);
+	(*gain_i) = gains.i + (((gains.i_hot - gains.i) * hot) >> 8);
+	(*gain_d) = gains.d + (((gains.d_hot - gains.d) * hot) >> 8);
+}
+
+// feedforward is added to approx_pwm(target), before the PID correction
+// all integer, target and current in 0.1 C, the integral in 0.1 C per check
+uint16_t pid(int16_t target, int16_t current, int32_t *integral, int16_t *last_error, int32_t feedforward)
+{
+	if (target == 0)
+	{
+		// turn off if target temperature is 0
+
+		(*integral) = 0;
+		(*last_error) = 0; // was set to the uninitialized error
+		return 0;
+	}
+	else
+	{
+		if (target < 0)
+		{
+			target = 0;
+		}
+
+		int16_t error = error_limit((int32_t)target - current); // calculate this after limiting target to 0 or above... else oven switches ON once cooling has a setpoint below 0.
+
+		int32_t gain_p, gain_i, gain_d;
+		pid_gains(target, &gain_p, &gain_i, &gain_d);
+
+		// calculate PID terms
+
+		int32_t p_term = (gain_p * error) >> GAIN_SHIFT;
+		int32_t new_integral = (*integral) + error;
+		new_integral = integral_limit(new_integral);
+		int32_t d_term = (gain_d * error_limit((int32_t)(*last_error) - error)) >> GAIN_SHIFT;
+		(*last_error) = error;
+		int32_t i_term = (gain_i * new_integral) >> GAIN_SHIFT;
+
+		int32_t result = approx_pwm(target) + feedforward + p_term + i_term + d_term;
+
+		// limit the integral so it doesn't get out of control
+		if ((result >= 65535 && new_integral < (*integral)) || (result < 0 && new_integral > (*integral)) || (result <= 65535 && result >= 0))
+		{
+			(*integral) = new_integral;
+		}
+
+		// limit the range and return the result for use as the PWM OCR value
+		return result > 65535 ? 65535 : (result < 0 ? 0 : result);
+	}
+}
+
+#if BUMPLESS_TRANSFER
+// bumpless transfer: back-calculates the integral, so that the PID correction (everything pid() adds to the feedforward)
+// of the next pid() call with this target is feedback, instead of jumping to wherever the new target would put it
+void pid_track(int16_t target, int16_t current, int32_t *integral, int16_t *last_error, int32_t feedback)
+{
+	int32_t gain_p, gain_i, gain_d;
+	if (target <= 0)
+	{
+		return; // pid() turns off or has nothing to track
+	}
+	pid_gains(target, &gain_p, &gain_i, &gain_d);
+
+	int16_t error = error_limit((int32_t)target - current);
+	(*last_error) = error; // no derivative kick either
+	if (gain_i > 0)
+	{
+		// pid() adds this error to the integral before using it
+		feedback = feedback > 65535 ? 65535 : (feedback < -65535 ? -65535 : feedback);
+		(*integral) = integral_limit(((feedback << GAIN_SHIFT) - gain_p * error) / gain_i - error);
+	}
+}
+#endif
+
+void profile_setdefault(profile_t *profile)
+{
+	profile_stages(profile, 1.0, 150.0, 185.0, 70, 217.5, 45, 2.0);
+}
+
+// the fixed preheat, soak, reflow and cool stages of older firmware as segments
+void profile_stages(profile_t *profile, double start_rate, double soak_temp1, double soak_temp2, uint16_t soak_length, double peak_temp, uint16_t time_to_peak, double cool_rate)
+{
+	for (uint8_t i = 0; i < PROFILE_SEGMENTS; i++)
+	{
+		segment_set(&profile->seg[i], SEGMENT_END, 0.0, 0.0);
+	}
+	segment_set(&profile->seg[0], SEGMENT_RAMP, soak_temp1, start_rate);			// preheat
+	segment_set(&profile->seg[1], SEGMENT_RAMP_TIME, soak_temp2, soak_length);	// soak
+	segment_set(&profile->seg[2], SEGMENT_RAMP_TIME, peak_temp, time_to_peak);	// reflow
+	segment_set(&profile->seg[3], SEGMENT_WAIT, peak_temp, 5.0);				// make sure it gets to the peak
+	segment_set(&profile->seg[4], SEGMENT_COOL, ROOM_TEMP * 1.25, cool_rate);
+}
+
+// the value of a segment in C/s, seconds or C, depending on the type
+double segment_value(segment_t *seg)
+{
+	switch (seg->type)
+	{
+	case SEGMENT_RAMP:
+	case SEGMENT_COOL:
+		return seg->value / 100.0;
+	case SEGMENT_WAIT:
+		return seg->value / 10.0;
+	default:
+		return seg->value;
+	}
+}
+
+void segment_set(segment_t *seg, uint8_t type, double temp, double value)
+{
+	seg->type = type;
+	seg->temp = (int16_t)lround(temp * 10.0);
+	if (type == SEGMENT_RAMP || type == SEGMENT_COOL)
+	{
+		value *= 100.0;
+	}
+	else if (type == SEGMENT_WAIT)
+	{
+		value *= 10.0;
+	}
+	seg->value = (uint16_t)lround(fmin(fmax(value, 0.0), 65535.0));
+}
+
+void settings_setdefault(settings_t *s)
+{
+	s->pid_p = 409.2; // 2000, 5 and -0.01 per AD595 count of older firmware
+	s->pid_i = 1.023;
+	s->pid_d = -GAIN_STEP; // one step, what pid() made of the -0.002 this used to be
+	s->max_temp = 230.0;
+	s->time_to_max = 220.0;
+	s->pid_p_hot = s->pid_p; // same gains everywhere until the oven is tuned hot
+	s->pid_i_hot = s->pid_i;
+	s->pid_d_hot = s->pid_d;
+	s->sched_low = 150.0;
+	s->sched_high = 217.5;
+}
+
+char profile_valid(profile_t *profile)
+{
+	for (uint8_t i = 0; i < PROFILE_SEGMENTS; i++)
+	{
+		segment_t *seg = &profile->seg[i];
+		if (seg->type == SEGMENT_END)
+		{
+			return i > 0; // at least one segment
+		}
+		if (seg->type >= SEGMENT_TYPES || seg->temp <= 0 || seg->temp > SEGMENT_TEMP_MAX)
+		{
+			return 0;
+		}
+		if ((seg->type == SEGMENT_RAMP || seg->type == SEGMENT_RAMP_TIME || seg->type == SEGMENT_COOL) && seg->value == 0)
+		{
+			return 0; // no rate or no time to ramp in
+		}
+	}
+	return 1;
+}
+
+// P and I from 0, D from -GAIN_LIMIT, up to GAIN_LIMIT
+static char gains_valid(double p, double i, double d)
+{
+	return p >= 0.0 && p <= GAIN_LIMIT && i >= 0.0 && i <= GAIN_LIMIT && d >= -GAIN_LIMIT && d <= GAIN_LIMIT;
+}
+
+char settings_valid(settings_t *s)
+{
+	return (s->max_temp > 0.0 && s->time_to_max > 0.0 && s->sched_high >= s->sched_low &&
+			gains_valid(s->pid_p, s->pid_i, s->pid_d) && gains_valid(s->pid_p_hot, s->pid_i_hot, s->pid_d_hot));
+}
+
+#if PEAK_PREDICTOR
+// Smith predictor
+// The toaster is modelled as a first order lag followed by OVEN_DEAD_TIME, going from ROOM_TEMP at 0% to max_temp
+// at 100% duty cycle and heating max_temp / time_to_max C/s at first, the same assumptions as approx_pwm() and rate_pwm().
+// The model runs without the dead time, so it is ahead of its own delayed output by the heat that is still on its way
+// to the thermocouple. Added to the reading, that is where the temperature is going to be once the dead time has passed.
+// Everything per check is integer math, the doubles are only used once at the start.
+static void predictor_init(predictor_t *p, int16_t cur_temp)
+{
+	double gain = fmax(settings.max_temp - ROOM_TEMP, 0.0);
+	double tau = gain * settings.time_to_max / settings.max_temp;
+	double alpha = tau > 0.0 ? (TMR_OVF_TIMESPAN * 256) / tau : 1.0;
+	p->alpha = (uint16_t)lround(fmin(alpha, 1.0 / 16.0) * 65536.0); // limited so the update can not overflow
+	p->room = (uint16_t)lround(ROOM_TEMP * 10 * 8);
+	p->gain = (uint16_t)lround(fmin(gain * 10 * 8, 65535.0 - p->room)); // so room + gain fits the history
+
+	long delay = lround(OVEN_DEAD_TIME / (TMR_OVF_TIMESPAN * 256));
+	p->delay = delay < 1 ? 1 : (delay > PREDICTOR_MAX_DELAY ? PREDICTOR_MAX_DELAY : delay);
+
+	p->model = (int32_t)cur_temp << 12;
+	for (uint8_t i = 0; i < p->delay; i++)
+	{
+		p->history[i] = cur_temp << 3;
+	}
+	p->idx = 0;
+}
+
+// returns the predicted reading
+static int16_t predictor_read(predictor_t *p, int16_t cur_temp)
+{
+	int32_t predicted = ((int32_t)cur_temp << 3) + (p->model >> 9) - p->history[p->idx];
+	return predicted < 0 ? 0 : (int16_t)(predicted >> 3);
+}
+
+// advances the model by one check, with the duty cycle that is used during it
+static void predictor_step(predictor_t *p, uint16_t pwm)
+{
+	p->history[p->idx] = p->model >> 9;
+	p->idx = (p->idx + 1) % p->delay;
+
+	int32_t steady = ((int32_t)p->room + (int32_t)(((uint32_t)p->gain * pwm) >> 16)) << 9;
+	p->model += (((steady - p->model) >> 8) * p->alpha) >> 8;
+}
+#endif
+
+#if RATE_ESTIMATOR
+// alpha-beta filter for the reading and how fast it changes
+// The heater is the input: the change the delayed model of the predictor expects is added to the prediction of each
+// check, the filter itself only has to follow what the model gets wrong (bias). Without the predictor it is a
+// plain alpha-beta filter with bias as the rate.
+#define ESTIMATOR_ALPHA_SHIFT 2 // alpha = 1/4
+#define ESTIMATOR_BETA_DIV 28	// beta = alpha^2 / (2 - alpha) = 1/28, critically damped
+
+static void estimator_init(estimator_t *e, int16_t cur_temp)
+{
+	e->temp = (int32_t)cur_temp << 16;
+	e->bias = 0;
+	e->rate = 0;
+	e->model_last = cur_temp << 3;
+}
+
+// returns the estimated reading in 0.1 C << 16, call before predictor_step() of the same check
+static int32_t estimator_update(estimator_t *e, int16_t cur_temp, predictor_t *p)
+{
+	int32_t input = 0;
+#if PEAK_PREDICTOR
+	// what the heater did to the reading since the last check, according to the model
+	uint16_t model = p->history[p->idx];
+	input = ((int32_t)model - e->model_last) << 13;
+	e->model_last = model;
+#endif
+	int32_t error = ((int32_t)cur_temp << 16) - (e->temp + input + e->bias);
+	e->temp += input + e->bias + (error >> ESTIMATOR_ALPHA_SHIFT);
+	e->bias += error / ESTIMATOR_BETA_DIV;
+	e->rate = input + e->bias;
+	return e->temp;
+}
+#endif
+
+// called at a stage change, the new stage starts its PID from scratch or, with BUMPLESS_TRANSFER, from where the old one was
+static void reflow_transfer(reflow_t *r)
+{
+#if BUMPLESS_TRANSFER
+	r->transfer = 1;
+#else
+	r->integral = 0;
+	r->last_error = 0;
+#endif
+}
+
+// estimate of how long a profile takes in seconds, ramps can not be faster than max_heat_rate
+double profile_duration(profile_t *profile, double max_heat_rate)
+{
+	double duration = 0.0;
+	double temp = ROOM_TEMP;
+	for (uint8_t i = 0; i < PROFILE_SEGMENTS && profile->seg[i].type != SEGMENT_END; i++)
+	{
+		segment_t *seg = &profile->seg[i];
+		double end = seg->temp / 10.0;
+		switch (seg->type)
+		{
+		case SEGMENT_RAMP:
+			duration += fabs(end - temp) / fmin(segment_value(seg), max_heat_rate);
+			break;
+		case SEGMENT_RAMP_TIME:
+		case SEGMENT_HOLD:
+			duration += segment_value(seg);
+			break;
+		case SEGMENT_COOL:
+			duration += fmax(temp - end, 0.0) / segment_value(seg);
+			break;
+		default: // wait takes as long as the ramp before it lags behind
+			break;
+		}
+		temp = end;
+	}
+	return duration;
+}
+
+#define RAMP_LEAD 8 // checks the setpoint of a ramp at a rate can run ahead of the reading
+
+// temperature in 0.1 C << 16, the unit of the setpoint table
+static int32_t setpoint_from_temperature(double temp)
+{
+	return lround(temp * 10.0 * 65536.0);
+}
+
+// compiles the profile into the setpoint table, so a check only has to add the step of its segment
+// the first segment starts at the reading, every other one at the temperature the previous segment is about
+static void reflow_compile(reflow_t *r, profile_t *profile, int16_t cur_temp)
+{
+	const double tick = TMR_OVF_TIMESPAN * 256;
+
+	// the segments at the peak temperature act on the prediction, that is where heat that is still on its way overshoots
+	int16_t peak = 0;
+	for (uint8_t i = 0; i < PROFILE_SEGMENTS && profile->seg[i].type != SEGMENT_END; i++)
+	{
+		peak = profile->seg[i].temp > peak ? profile->seg[i].temp : peak;
+	}
+
+	double temp = deci_to_temperature(cur_temp);
+	for (uint8_t i = 0; i < PROFILE_SEGMENTS; i++)
+	{
+		segment_t *seg = &profile->seg[i];
+		reflow_segment_t *c = &r->table[i];
+		double end = seg->temp / 10.0;
+		double value = segment_value(seg);
+		double rate = 0.0; // C/s
+
+		c->type = seg->type;
+		if (c->type == SEGMENT_END)
+		{
+			break;
+		}
+		c->predict = PEAK_PREDICTOR && seg->temp == peak && c->type != SEGMENT_COOL;
+		c->length = 0;
+		c->start = setpoint_from_temperature(temp);
+		c->end = setpoint_from_temperature(end);
+		c->until = c->end;
+
+		switch (c->type)
+		{
+		case SEGMENT_RAMP:
+			rate = value; // made negative when it starts above temp
+			break;
+		case SEGMENT_RAMP_TIME:
+			rate = (end - temp) / value;
+			// fall through
+		case SEGMENT_HOLD:
+			// the segment is over once the checks add up to more than value seconds, rounded to whole seconds
+			c->length = (uint16_t)fmin(ceil((value + 0.5) / tick) - 1.0, 65534.0);
+			if (c->type == SEGMENT_HOLD)
+			{
+				c->start = c->end;
+			}
+			break;
+		case SEGMENT_WAIT:
+			// aim past temp so it gets there even if the oven does not heat up as much as approx_pwm() says
+			c->start = c->end = setpoint_from_temperature(end + value);
+			break;
+		case SEGMENT_COOL:
+			// keeps going past temp, holding the oven at temp would only make it take longer to get below it
+			rate = -value;
+			c->end = 0;
+			break;
+		default:
+			break;
+		}
+		c->step = lround(rate * tick * 10.0 * 65536.0);
+		c->feedforward = lround(rate_pwm(rate));
+		temp = end;
+	}
+}
+
+// starts the next segment, or ends the profile after the last one
+static void reflow_next(reflow_t *r, int32_t reading)
+{
+	r->stage++;
+	r->length_cnt = 0;
+	if (r->stage >= REFLOW_STAGE_DONE || r->table[(uint8_t)r->stage].type == SEGMENT_END)
+	{
+		r->stage = REFLOW_STAGE_DONE;
+		return;
+	}
+
+	reflow_segment_t *c = &r->table[(uint8_t)r->stage];
+	if (c->type == SEGMENT_RAMP)
+	{
+		// starts at the reading, towards temp from wherever that is
+		c->start = reading;
+		if (reading > c->until)
+		{
+			c->step = -c->step;
+			c->feedforward = -c->feedforward;
+		}
+	}
+	r->setpoint = c->start;
+	r->step = c->step;
+	r->ramp_ff = c->feedforward;
+
+	if (c->type == SEGMENT_COOL)
+	{
+		r->integral = 0;
+		r->last_error = 0;
+		r->transfer = 0; // cool down starts from scratch, carrying the heating over would only keep the peak going longer
+	}
+	else if (r->total_cnt > 0)
+	{
+		reflow_transfer(r);
+	}
+}
+
+void reflow_init(reflow_t *r, profile_t *profile, int16_t cur_temp)
+{
+	pid_init();
+	r->stage = -1; // reflow_next() starts the first segment
+	r->total_cnt = 0;
+	r->pwm_ocr = 0;
+	r->integral = 0;
+	r->last_error = 0;
+	r->transfer = 0;
+	r->feedforward = 0;
+#if PEAK_PREDICTOR
+	predictor_init(&r->pred, cur_temp);
+#endif
+#if RATE_ESTIMATOR
+	estimator_init(&r->est, cur_temp);
+#endif
+	reflow_compile(r, profile, cur_temp);
+	reflow_next(r, (int32_t)cur_temp << 16);
+	r->tgt_temp = cur_temp;
+}
+
+// PID for the setpoint of this check, with the slope of the setpoint as feedforward
+static uint16_t reflow_pid(reflow_t *r, int16_t current)
+{
+	int16_t target = r->tgt_temp;
+	int32_t feedforward = r->ramp_ff;
+#if BUMPLESS_TRANSFER
+	// continue with the correction the previous stage ended with, only the feedforward changes with the stage
+	// a saturated output says nothing about what the correction was, then the integral is carried over as it is
+	if (r->transfer > 0 && r->pwm_ocr > 0 && r->pwm_ocr < 65535)
+	{
+		pid_track(target, current, &r->integral, &r->last_error, (int32_t)r->pwm_ocr - r->feedforward);
+	}
+	r->transfer = 0;
+	r->feedforward = approx_pwm(target) + feedforward;
+#endif
+#if RATE_ESTIMATOR
+	// pid() takes the derivative from last_error - error, the change of the error since the last check
+	// make that the estimated rate of the reading minus the rate of the target, instead of a difference of two noisy readings
+	r->last_error = (target - current) + (int16_t)((r->est.rate - r->step + 0x8000) >> 16);
+#endif
+	return pid(target, current, &r->integral, &r->last_error, feedforward);
+}
+
+// runs the state machine for one temperature check, every TMR_OVF_TIMESPAN * 256 seconds
+// the resulting duty cycle is left in r->pwm_ocr
+void reflow_step(reflow_t *r, int16_t cur_temp)
+{
+	r->total_cnt++;
+
+	// readings in 0.1 C << 16, like the setpoints
+#if RATE_ESTIMATOR
+	int32_t measured = estimator_update(&r->est, cur_temp, &r->pred);
+#else
+	int32_t measured = (int32_t)cur_temp << 16;
+#endif
+#if PEAK_PREDICTOR
+	int32_t predicted = (int32_t)predictor_read(&r->pred, (int16_t)((measured + 0x8000) >> 16)) << 16;
+#else
+	int32_t predicted = measured;
+#endif
+
+	while (r->stage != REFLOW_STAGE_DONE)
+	{
+		reflow_segment_t *c = &r->table[(uint8_t)r->stage];
+		int32_t reading = c->predict ? predicted : measured;
+		char done;
+
+		r->length_cnt++;
+		switch (c->type)
+		{
+		case SEGMENT_RAMP:
+			done = c->step > 0 ? reading >= c->until : reading <= c->until;
+			break;
+		case SEGMENT_WAIT:
+			done = reading >= c->until;
+			break;
+		case SEGMENT_COOL:
+			done = reading < c->until;
+			break;
+		default: // ramp time and hold
+			done = r->length_cnt > c->length;
+			break;
+		}
+		if (done)
+		{
+			reflow_next(r, reading); // and run the next segment in this check
+			continue;
+		}
+
+		// the setpoint is a lookup: add the step, stop at the end
+		r->setpoint += r->step;
+		if (c->type == SEGMENT_RAMP && r->step != 0)
+		{
+			// stay close to the reading, so a ramp faster than the oven can go does not wind up
+			// not once the setpoint is at the end, a setpoint following the reading would heat it further
+			int32_t lead = reading + RAMP_LEAD * r->step;
+			r->setpoint = r->step > 0 ? (r->setpoint < lead ? r->setpoint : lead) : (r->setpoint > lead ? r->setpoint : lead);
+		}
+		if ((r->step > 0 && r->setpoint >= c->end) || (r->step < 0 && r->setpoint <= c->end))
+		{
+			r->setpoint = c->end;
+			r->step = 0;
+			r->ramp_ff = 0;
+		}
+		// a negative target would turn the heater off in pid(), keep it at 0 so the display makes sense
+		r->tgt_temp = r->setpoint > 0 ? (int16_t)((r->setpoint + 0x8000) >> 16) : 0;
+		r->pwm_ocr = reflow_pid(r, (int16_t)((reading + 0x8000) >> 16));
+		break;
+	}
+
+	if (r->stage == REFLOW_STAGE_DONE)
+	{
+		r->pwm_ocr = 0; // turn off
+		r->tgt_temp = temperature_to_deci(ROOM_TEMP);
+	}
+
+#if PEAK_PREDICTOR
+	predictor_step(&r->pred, r->pwm_ocr);
+#endif
+}
@@ -0,0 +1,505 @@
+/* Serial command interface
+ *
+ * Lines received on the UART are executed as commands, so settings and profiles can be
+ * configured from a PC (see tools/reflowctl.py) instead of through the rotary encoder.
+ *
+ * Every command is answered with "ok," or "err, <reason>," after any output it produces,
+ * lines starting with a digit are CSV log / telemetry lines and not responses.
+ *
+ *   help                                   list the commands
+ *   settings                               print settings: pid_p, pid_i, pid_d, max_temp, time_to_max,
+ *                                            pid_p_hot, pid_i_hot, pid_d_hot, sched_low, sched_high
+ *   settings <5 or 10 values in that order> validate and save settings to EEPROM, 5 keep the gain schedule,
+ *                                            gains go up to 1024 (GAIN_LIMIT), in steps of 1/256, D can be negative
+ *   profile                                print profile: type, temperature, value of every segment until the first end
+ *   profile <type temp value>...           validate and save profile to EEPROM, 1 to 8 segments, see SEGMENT_* for the types
+ *   slot                                   print the selected profile slot and the names of all slots
+ *   slot <1-4>                             select the profile slot that profile, start and the menus use
+ *   name <text>                            rename the selected profile slot, up to 10 characters without commas
+ *   runs                                   print how many automatic runs have been started
+ *   start                                  run the selected profile (from the main menu)
+ *   abort                                  turn off the heater and leave the running mode
+ *   temp <C>                               manual temperature control at this setpoint
+ *   pwm <0-65535>                          manual PWM control at this duty cycle
+ *   tele <0|1>                             turn the CSV log / telemetry stream off or on
+ *   dump                                   print the recording of the last automatic run as hex, see recorder.cpp
+ *   mem                                    print bytes of RAM: static data, free now, never reached by the stack
+ *
+ * Action commands (start, abort, temp, pwm) are acknowledged once the menu loop that is
+ * active has picked them up, they are not picked up while a settings or profile edit menu is open.
+ * While an automatic run is going on, settings and dump answer "err, running,", and so do profile, slot
+ * and name when they would write: an EEPROM record write or the dump would stall the control loop, and a
+ * record write needs stack the run has not got.
+ */
+
+#include <Arduino.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "reflowtoasteroven.h"
+#include "serialcmd.h"
+#include "nvm.h"
+#include "menu.h" // for str_from_double
+#include "recorder.h"
+#include "meminfo.h"
+
+#if SERIAL_COMMANDS
+
+#define CMD_LINE_SIZE 160 // fits a profile line with all segments, temperatures at 5 and values at 4 digits
+#define CMD_MAX_VALUES (3 * PROFILE_SEGMENTS)
+
+static char cmd_line[CMD_LINE_SIZE];
+static uint8_t cmd_line_len = 0;
+static char cmd_overflow = 0;
+static char cmd_action = CMD_NONE;
+static char cmd_running = 0;
+double cmd_arg = 0.0;
+char cmd_telemetry = 1;
+
+// parse a decimal number like -12.75, no exponents. Returns the position after the number, or 0 on a syntax error
+static char *parse_double(char *s, double *result)
+{
+	char negative = 0;
+	char digits = 0;
+	double value = 0.0;
+	double divider = 1.0;
+
+	while (*s == ' ')
+	{
+		s++;
+	}
+
+	if (*s == '-')
+	{
+		negative = 1;
+		s++;
+	}
+
+	while (*s >= '0' && *s <= '9')
+	{
+		value = value * 10.0 + (*s - '0');
+		digits++;
+		s++;
+	}
+
+	if (*s == '.')
+	{
+		s++;
+		while (*s >= '0' && *s <= '9')
+		{
+			value = value * 10.0 + (*s - '0');
+			divider *= 10.0;
+			digits++;
+			s++;
+		}
+	}
+
+	if (digits == 0 || (*s != ' ' && *s != 0))
+	{
+		return 0;
+	}
+
+	*result = (negative ? -value : value) / divider;
+	return s;
+}
+
+// parse all numbers following the command, returns how many there were or -1 on a syntax error
+static int8_t parse_values(char *s, double *values)
+{
+	int8_t n = 0;
+	while (*s != 0)
+	{
+		if (*s == ' ')
+		{
+			s++;
+			continue;
+		}
+		if (n == CMD_MAX_VALUES)
+		{
+			return -1;
+		}
+		s = parse_double(s, &values[n]);
+		if (s == 0)
+		{
+			return -1;
+		}
+		n++;
+	}
+	return n;
+}
+
+static void reply_ok()
+{
+	fprintf_P(&log_stream, PSTR("ok,\n"));
+}
+
+static void reply_err(const char *reason_P)
+{
+	fprintf_P(&log_stream, PSTR("err, %S,\n"), reason_P);
+}
+
+// replies with an error if the command has to wait until the run is over
+static char cmd_idle()
+{
+	if (cmd_running)
+	{
+		reply_err(PSTR("running"));
+		return 0;
+	}
+	return 1;
+}
+
+static void print_value(double value, int decimalplaces)
+{
+	fprintf_P(&log_stream, PSTR(" %s,"), str_from_double(value, decimalplaces));
+}
+
+static void cmd_settings(double *values, int8_t n)
+{
+	if (!cmd_idle())
+	{
+		return; // the run works with the settings it started with, reading them back is no use
+	}
+	if (n == 0)
+	{
+		settings_load(&settings);
+		fprintf_P(&log_stream, PSTR("settings,"));
+		print_value(settings.pid_p, GAIN_DECIMALS);
+		print_value(settings.pid_i, GAIN_DECIMALS);
+		print_value(settings.pid_d, GAIN_DECIMALS);
+		print_value(settings.max_temp, 1);
+		print_value(settings.time_to_max, 0);
+		print_value(settings.pid_p_hot, GAIN_DECIMALS);
+		print_value(settings.pid_i_hot, GAIN_DECIMALS);
+		print_value(settings.pid_d_hot, GAIN_DECIMALS);
+		print_value(settings.sched_low, 1);
+		print_value(settings.sched_high, 1);
+		fprintf_P(&log_stream, PSTR("\n"));
+		reply_ok();
+		return;
+	}
+
+	if (n != 5 && n != 10)
+	{
+		reply_err(PSTR("expected 5 or 10 values"));
+		return;
+	}
+
+	settings_t s = settings; // 5 values leave the gain schedule as it is
+	s.pid_p = values[0];
+	s.pid_i = values[1];
+	s.pid_d = values[2];
+	s.max_temp = values[3];
+	s.time_to_max = values[4];
+	if (n == 10)
+	{
+		s.pid_p_hot = values[5];
+		s.pid_i_hot = values[6];
+		s.pid_d_hot = values[7];
+		s.sched_low = values[8];
+		s.sched_high = values[9];
+	}
+	if (!settings_valid(&s))
+	{
+		reply_err(PSTR("invalid settings"));
+		return;
+	}
+
+	settings = s;
+	settings_save(&settings);
+	reply_ok();
+}
+
+static void cmd_profile(double *values, int8_t n)
+{
+	profile_t p;
+
+	if (n == 0)
+	{
+		profile_load(&p);
+		fprintf_P(&log_stream, PSTR("profile,"));
+		for (uint8_t i = 0; i < PROFILE_SEGMENTS && p.seg[i].type != SEGMENT_END; i++)
+		{
+			fprintf_P(&log_stream, PSTR(" %d,"), p.seg[i].type);
+			print_value(p.seg[i].temp / 10.0, 1);
+			print_value(segment_value(&p.seg[i]), 2);
+		}
+		fprintf_P(&log_stream, PSTR("\n"));
+		reply_ok();
+		return;
+	}
+
+	if (!cmd_idle())
+	{
+		return;
+	}
+	if (n % 3 != 0)
+	{
+		reply_err(PSTR("expected type, temp, value for every segment"));
+		return;
+	}
+
+	for (uint8_t i = 0; i < PROFILE_SEGMENTS; i++)
+	{
+		if (i < n / 3)
+		{
+			double *v = &values[3 * i];
+			// checked before segment_set(), which would wrap a temperature that does not fit
+			if (v[0] < 0 || v[0] >= SEGMENT_TYPES || v[0] != (uint8_t)v[0] || v[1] < 0 || v[1] > SEGMENT_TEMP_MAX / 10.0 ||
+				v[2] < 0 || v[2] > 65535.0)
+			{
+				reply_err(PSTR("bad segment"));
+				return;
+			}
+			segment_set(&p.seg[i], (uint8_t)v[0], v[1], v[2]);
+		}
+		else
+		{
+			segment_set(&p.seg[i], SEGMENT_END, 0.0, 0.0);
+		}
+	}
+	if (!profile_valid(&p))
+	{
+		reply_err(PSTR("invalid profile"));
+		return;
+	}
+
+	profile_save(&p);
+	reply_ok();
+}
+
+static void cmd_slot(double *values, int8_t n)
+{
+	char name[PROFILE_NAME_SIZE + 1];
+
+	if (n == 1)
+	{
+		if (!cmd_idle())
+		{
+			return;
+		}
+		if (values[0] < 1 || values[0] > PROFILE_SLOTS || values[0] != (uint8_t)values[0])
+		{
+			reply_err(PSTR("out of range"));
+			return;
+		}
+		profile_select((uint8_t)values[0] - 1);
+	}
+	else if (n != 0)
+	{
+		reply_err(PSTR("wrong number of values"));
+		return;
+	}
+
+	fprintf_P(&log_stream, PSTR("slot, %d,"), profile_selected() + 1);
+	for (uint8_t slot = 0; slot < PROFILE_SLOTS; slot++)
+	{
+		profile_name(slot, name);
+		fprintf_P(&log_stream, PSTR(" %s,"), name);
+	}
+	fprintf_P(&log_stream, PSTR("\n"));
+	reply_ok();
+}
+
+static void cmd_name(char *name)
+{
+	uint8_t len = strlen(name);
+	if (!cmd_idle())
+	{
+		return;
+	}
+	if (len == 0 || len > PROFILE_NAME_SIZE)
+	{
+		reply_err(PSTR("expected 1 to 10 characters"));
+		return;
+	}
+	for (uint8_t i = 0; i < len; i++)
+	{
+		if (name[i] < ' ' || name[i] > '~' || name[i] == ',')
+		{
+			reply_err(PSTR("bad character"));
+			return;
+		}
+	}
+	profile_rename(profile_selected(), name);
+	reply_ok();
+}
+
+// request an action from the menu loops, it is acknowledged when it is picked up
+static void cmd_request(char action, double *values, int8_t n, int8_t expected)
+{
+	if (n != expected)
+	{
+		reply_err(PSTR("wrong number of values"));
+		return;
+	}
+	if (cmd_action != CMD_NONE)
+	{
+		// the previous action has not been picked up yet
+		reply_err(PSTR("busy"));
+		return;
+	}
+	cmd_action = action;
+	cmd_arg = expected ? values[0] : 0.0;
+}
+
+static void cmd_execute(char *line)
+{
+	double values[CMD_MAX_VALUES];
+	char *args = strchr(line, ' ');
+
+	if (args != 0)
+	{
+		*args = 0; // terminate the command word
+		args++;
+	}
+	else
+	{
+		args = line + strlen(line);
+	}
+
+	if (strcmp_P(line, PSTR("name")) == 0)
+	{
+		cmd_name(args); // text, not numbers
+		return;
+	}
+
+	int8_t n = parse_values(args, values);
+	if (n < 0)
+	{
+		reply_err(PSTR("bad number"));
+		return;
+	}
+
+	if (strcmp_P(line, PSTR("settings")) == 0)
+	{
+		cmd_settings(values, n);
+	}
+	else if (strcmp_P(line, PSTR("profile")) == 0)
+	{
+		cmd_profile(values, n);
+	}
+	else if (strcmp_P(line, PSTR("slot")) == 0)
+	{
+		cmd_slot(values, n);
+	}
+	else if (strcmp_P(line, PSTR("start")) == 0)
+	{
+		cmd_request(CMD_START, values, n, 0);
+	}
+	else if (strcmp_P(line, PSTR("abort")) == 0)
+	{
+		cmd_request(CMD_ABORT, values, n, 0);
+	}
+	else if (strcmp_P(line, PSTR("temp")) == 0)
+	{
+		if (n == 1 && (values[0] < 0 || values[0] > settings.max_temp))
+		{
+			reply_err(PSTR("out of range"));
+			return;
+		}
+		cmd_request(CMD_TEMP, values, n, 1);
+	}
+	else if (strcmp_P(line, PSTR("pwm")) == 0)
+	{
+		if (n == 1 && (values[0] < 0 || values[0] > 65535.0))
+		{
+			reply_err(PSTR("out of range"));
+			return;
+		}
+		cmd_request(CMD_PWM, values, n, 1);
+	}
+	else if (strcmp_P(line, PSTR("tele")) == 0)
+	{
+		if (n != 1)
+		{
+			reply_err(PSTR("wrong number of values"));
+			return;
+		}
+		cmd_telemetry = (values[0] != 0);
+		reply_ok();
+	}
+	else if (strcmp_P(line, PSTR("runs")) == 0)
+	{
+		fprintf_P(&log_stream, PSTR("runs, %u,\n"), nvm_runs());
+		reply_ok();
+	}
+#if RUN_RECORDER
+	else if (strcmp_P(line, PSTR("dump")) == 0)
+	{
+		if (cmd_idle()) // the dump takes seconds, and the run is still recording
+		{
+			rec_dump();
+			reply_ok();
+		}
+	}
+#endif
+#if STACK_MONITOR
+	else if (strcmp_P(line, PSTR("mem")) == 0)
+	{
+		fprintf_P(&log_stream, PSTR("mem, %u, %u, %u,\n"), mem_static(), mem_free(), mem_stack_unused());
+		reply_ok();
+	}
+#endif
+	else if (strcmp_P(line, PSTR("help")) == 0)
+	{
+		fprintf_P(&log_stream, PSTR("commands, settings, profile, slot, name, runs, start, abort, temp, pwm, tele, dump, mem,\n"));
+		reply_ok();
+	}
+	else
+	{
+		reply_err(PSTR("unknown command"));
+	}
+}
+
+char cmd_poll()
+{
+	while (Serial.available() > 0)
+	{
+		char c = Serial.read();
+
+		if (c == '\r' || c == '\n')
+		{
+			if (cmd_overflow)
+			{
+				reply_err(PSTR("line too long"));
+			}
+			else if (cmd_line_len > 0)
+			{
+				cmd_line[cmd_line_len] = 0;
+				cmd_execute(cmd_line);
+			}
+			cmd_line_len = 0;
+			cmd_overflow = 0;
+		}
+		else if (cmd_line_len < CMD_LINE_SIZE - 1)
+		{
+			cmd_line[cmd_line_len++] = c;
+		}
+		else
+		{
+			cmd_overflow = 1;
+		}
+	}
+
+	return cmd_action;
+}
+
+void cmd_accept()
+{
+	cmd_action = CMD_NONE;
+	reply_ok();
+}
+
+void cmd_reject()
+{
+	cmd_action = CMD_NONE;
+	reply_err(PSTR("busy"));
+}
+
+void cmd_run(char running)
+{
+	cmd_running = running;
+}
+
+#endif
@@ -22,22 +22,31 @@
  *
  *
  * This file contains routines to take temperature measurements from the AD595AQ thermocouple IC using the AVR's ADC
+ * and the part of the sensor interface that does not depend on the converter
  *
  */
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "reflowtoasteroven.h"
 #include "temperaturemeasurement.h"
 
-#define ADC_SAMPLE_SIZE 128
+#define ADC_SAMPLE_SIZE (128/SENSOR_CHANNELS) // per channel, the channels take turns so this covers the same time as 128 samples of one
 #define ADC_AVERAGE_SIZE (ADC_SAMPLE_SIZE/4)
-volatile uint16_t adc_samples[ADC_SAMPLE_SIZE];
+#define ADC_CLOCK (F_CPU / 128) // the slowest prescaler
+#define ADC_KEEP ((ADC_CLOCK + 31250) / 62500) // conversions per sample, so the samples cover the same time as at 8 MHz at any clock
+#define ADC_START (_BV(ADEN) | _BV(ADSC) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0))
+static_assert(ADC_CLOCK >= 50000 && ADC_CLOCK <= 200000, "the ADC clock has to be 50 to 200 kHz for full resolution");
+volatile uint16_t adc_samples[SENSOR_CHANNELS][ADC_SAMPLE_SIZE];
 volatile uint8_t adc_sample_idx;
-uint16_t temp_last_read = 0;
+volatile uint8_t adc_channel;
+uint16_t temp_last_read[SENSOR_CHANNELS];
+static const uint8_t adc_pins[] = {TEMP_MEASURE_CHAN, TEMP_AIR_CHAN};
 
 /*
  * This file contains code that is specific for measuring the temperature using the AD595AQ
@@ -50,7 +59,7 @@ uint16_t temp_last_read = 0;
  * 
 */
 
-uint16_t sensor_read()
+static uint16_t ad595_filter(uint8_t channel)
 {
 	int i, j;
 	uint16_t working_sample;
@@ -63,7 +72,7 @@ uint16_t sensor_read()
 	// determine the crest and troughs of the wave
 	for (i = 0; i < ADC_SAMPLE_SIZE; i++)
 	{
-		working_sample = adc_samples[i];
+		working_sample = adc_samples[channel][i];
 		
 		if (working_sample > maximum)
 		{
@@ -83,7 +92,7 @@ uint16_t sensor_read()
 	// average recent peak values while ignoring troughs
 	for (i = 0, j = adc_sample_idx; sum_cnt < ADC_AVERAGE_SIZE; i++)
 	{
-		working_sample = adc_samples[j];
+		working_sample = adc_samples[channel][j];
 		if (working_sample >= middle)
 		{
 			sum += working_sample;
@@ -93,58 +102,226 @@ uint16_t sensor_read()
 		j = (j + ADC_SAMPLE_SIZE - 1) % ADC_SAMPLE_SIZE;
 	}
 	
-	uint16_t result = (uint16_t)lround((double)sum / (double)sum_cnt);
-	if (result < temp_last_read - 5 && temp_last_read > 5)
+	uint16_t result = (sum + sum_cnt / 2) / sum_cnt;
+	if (result < temp_last_read[channel] - 5 && temp_last_read[channel] > 5)
 	{
-		result = temp_last_read - 5;
+		result = temp_last_read[channel] - 5;
 	}
 	//else
 	{
-		temp_last_read = result;
+		temp_last_read[channel] = result;
 	}
 	
 	return result;
 }
 
-void sensor_filter_reset()
+// new sample has arrived - use interrupt - won't cause issues with arduino since arduino does not use ADC interrupt
+ISR(ADC_vect)
 {
-	temp_last_read = 0;
+#if ADC_KEEP > 1
+	static uint8_t adc_skip;
+	if (++adc_skip < ADC_KEEP)
+	{
+		ADCSRA = ADC_START; // the same channel again, only the last conversion of ADC_KEEP is kept
+		return;
+	}
+	adc_skip = 0;
+#endif
+
+	// read in sample
+	adc_samples[adc_channel][adc_sample_idx] = ADCL;
+	adc_samples[adc_channel][adc_sample_idx] |= (ADCH << 8);
+	if (++adc_channel == SENSOR_CHANNELS)
+	{
+		adc_channel = 0;
+		adc_sample_idx = (adc_sample_idx + 1) % ADC_SAMPLE_SIZE;
+	}
+	
+	// initiate next reading, on the next channel
+	ADMUX = _BV(REFS0) | adc_pins[adc_channel];
+	ADCSRA = ADC_START;
 }
 
-// conversion functions
-uint16_t temperature_to_sensor(double temp)
+
+static void ad595_init()
 {
-	return (uint16_t)lround(temp / THERMOCOUPLE_CONSTANT);
+	adc_sample_idx = 0;
+	adc_channel = 0;
+	ADMUX = _BV(REFS0) | TEMP_MEASURE_CHAN; // set channel and reference
+	ADCSRA = ADC_START; // initialize first reading, with slowest prescaler, and enable ADC interrupt
+	ADCSRB = 0; // 0 is the default (for free running mode and no analog comperator)
+	DIDR0 = (1<<TEMP_MEASURE_CHAN); // disable digital input buffer on analog input pin
+	if (SENSOR_CHANNELS > 1)
+	{
+		DIDR0 |= (1<<TEMP_AIR_CHAN);
+	}
 }
 
-uint16_t temperature_to_sensor(float temp)
+static void ad595_start()
 {
-	return (uint16_t)lround(temp / THERMOCOUPLE_CONSTANT);
+	// the ADC keeps running, only the filter starts over
+	for (uint8_t i = 0; i < SENSOR_CHANNELS; i++)
+	{
+		temp_last_read[i] = 0;
+	}
 }
 
-uint16_t temperature_to_sensor(int temp)
+static char ad595_poll()
 {
-	return (uint16_t)lround(temp / THERMOCOUPLE_CONSTANT);
+	return 1; // the samples are always there, the filter works on the newest ones
 }
 
-// new sample has arrived - use interrupt - won't cause issues with arduino since arduino does not use ADC interrupt
-ISR(ADC_vect)
+#define CENTI_PER_1000_COUNTS ((int32_t)(THERMOCOUPLE_CONSTANT * 100000 + 0.5))
+
+static int32_t ad595_read(uint8_t channel)
 {
-	// read in sample
-	adc_samples[adc_sample_idx] = ADCL;
-	adc_samples[adc_sample_idx] |= (ADCH << 8);
-	adc_sample_idx = (adc_sample_idx + 1) % ADC_SAMPLE_SIZE;
-	
-	// initiate next reading
-	ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+	return ((int32_t)ad595_filter(channel) * CENTI_PER_1000_COUNTS + 500) / 1000;
 }
 
+static uint8_t ad595_fault(uint8_t channel)
+{
+	return 0; // the alarm output of the AD595 is not connected
+}
 
-void adc_init()
+// The AD595 is not linear, it amplifies the type K voltage (plus 11 uV) 247.3 times, which is 10 mV/C only
+// around 25 C. Its output in mV is what it reads as in 0.1 C, at the type K voltages (in uV, from the
+// NIST ITS-90 table) of 0, 100 ... 500 C. It reads 1.5 C high at 200 C and 11 C high at 500 C.
+constexpr int16_t ad595_reads(int32_t uv)
 {
-	adc_sample_idx = 0;
-	ADMUX = _BV(REFS0) | TEMP_MEASURE_CHAN; // set channel and reference
-	ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0); // initialize first reading, with slowest prescaler, and enable ADC interrupt
-	ADCSRB = 0; // 0 is the default (for free running mode and no analog comperator)
-	DIDR0 = (1<<TEMP_MEASURE_CHAN); // disable digital input buffer on analog input pin
-}
\ No newline at end of file
+	return (int16_t)(((uv + 11) * 2473 + 5000) / 10000);
+}
+
+static const calibration_t calibration_ad595 PROGMEM = {
+	0,
+	{ad595_reads(0), ad595_reads(4096), ad595_reads(8138), ad595_reads(12209), ad595_reads(16397), ad595_reads(20644)},
+	{0, 1000, 2000, 3000, 4000, 5000}};
+
+const calibration_t calibration_none PROGMEM = {
+	0,
+	{0, 1000, 2000, 3000, 4000, 5000},
+	{0, 1000, 2000, 3000, 4000, 5000}};
+
+const sensor_driver_t sensor_ad595 = {ad595_init, ad595_start, ad595_poll, ad595_read, ad595_fault, &calibration_ad595};
+
+// converter independent part, the rest of the firmware works in 0.1 C
+
+#define SENSOR_FULL_SCALE 5000 // what a fault reads as, the end of the AD595 range is hotter than any setpoint so nothing heats
+#define SENSOR_MIX_Q8 ((int16_t)(SENSOR_MIX * 256 + 0.5))
+
+static const sensor_driver_t* const sensor = &TEMP_SENSOR;
+static int16_t sensor_last[SENSOR_CHANNELS];
+static uint8_t sensor_last_fault;
+static calibration_t calibration;
+
+void sensor_init()
+{
+	calibration_setdefault(&calibration);
+	sensor->init();
+	sensor->start();
+}
+
+void calibration_setdefault(calibration_t* cal)
+{
+	memcpy_P(cal, sensor->calibration, sizeof(calibration_t));
+}
+
+char calibration_valid(calibration_t* cal)
+{
+	for (uint8_t i = 0; i < CALIBRATION_POINTS; i++)
+	{
+		if (cal->raw[i] < 0 || cal->raw[i] > CALIBRATION_MAX || cal->temp[i] < 0 || cal->temp[i] > CALIBRATION_MAX)
+		{
+			return 0; // calibrated() relies on this
+		}
+		if (i != 0 && (cal->raw[i] <= cal->raw[i - 1] || cal->temp[i] < cal->temp[i - 1]))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void sensor_calibrate(calibration_t* cal)
+{
+	calibration = *cal;
+}
+
+#define CALIBRATION_RAW_LIMIT 150000L // 0.01 C, readings are clamped to this, far beyond any converter
+static_assert((CALIBRATION_RAW_LIMIT + CALIBRATION_MAX * 10L) * CALIBRATION_MAX <= INT32_MAX, "the product in calibrated() can overflow");
+
+// a reading in 0.01 C through the calibration, all integer math
+// the first and the last line go on past the ends
+static int32_t calibrated(int32_t raw)
+{
+	if (raw > CALIBRATION_RAW_LIMIT)
+	{
+		raw = CALIBRATION_RAW_LIMIT;
+	}
+	else if (raw < -CALIBRATION_RAW_LIMIT)
+	{
+		raw = -CALIBRATION_RAW_LIMIT;
+	}
+
+	uint8_t i = 1;
+	while (i < CALIBRATION_POINTS - 1 && raw > calibration.raw[i] * 10L)
+	{
+		i++;
+	}
+	int32_t x0 = calibration.raw[i - 1] * 10L;
+	int32_t y0 = calibration.temp[i - 1] * 10L;
+	int32_t dx = calibration.raw[i] - calibration.raw[i - 1]; // in 0.1 C, so the product fits, see calibration_valid()
+	int32_t dy = calibration.temp[i] - calibration.temp[i - 1];
+	return y0 + ((raw - x0) * dy + dx / 2) / dx + calibration.offset * 10L;
+}
+
+void sensor_filter_reset()
+{
+	sensor->start();
+}
+
+// the reading the control works on, see SENSOR_MIX
+static int16_t sensor_combine()
+{
+#if SENSOR_CHANNELS > 1
+	if (SENSOR_MIX == SENSOR_MIX_MAX)
+	{
+		return sensor_last[0] > sensor_last[1] ? sensor_last[0] : sensor_last[1];
+	}
+	return sensor_last[0] + (int16_t)(((int32_t)(sensor_last[1] - sensor_last[0]) * SENSOR_MIX_Q8 + 128) >> 8);
+#else
+	return sensor_last[0];
+#endif
+}
+
+int16_t sensor_read()
+{
+	if (sensor->poll())
+	{
+		sensor_last_fault = 0;
+		for (uint8_t i = 0; i < SENSOR_CHANNELS; i++)
+		{
+			uint8_t fault = sensor->fault(i);
+			if (fault != 0)
+			{
+				sensor_last[i] = SENSOR_FULL_SCALE;
+			}
+			else
+			{
+				int32_t temp = calibrated(sensor->read(i));
+				sensor_last[i] = temp <= 0 ? 0 : temp >= INT16_MAX * 10L ? INT16_MAX : (temp + 5) / 10;
+			}
+			sensor_last_fault |= fault;
+		}
+	}
+	return sensor_combine();
+}
+
+int16_t sensor_read_channel(uint8_t channel)
+{
+	return sensor_last[channel];
+}
+
+uint8_t sensor_fault()
+{
+	return sensor_last_fault;
+}
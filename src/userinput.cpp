@@ -2,7 +2,7 @@
 #include "userinput.h"
 #include <Arduino.h>
 
-Encoder RotEnc(2,3); // rotary encoder connected to interrupt pins, pins 2 and 3 on arduino uno, pd2 and pd3 on atmega328
+Encoder RotEnc(pin_encoder_a::arduino, pin_encoder_b::arduino); // rotary encoder connected to interrupt pins, see board.h
 void button_init(){
-    pinMode(4,INPUT_PULLUP); // button on rotary encoder connected to pd4 = pin 4 on arduino uno
+    pin_button::input_pullup(); // button on rotary encoder
 }
\ No newline at end of file
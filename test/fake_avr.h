@@ -0,0 +1,18 @@
+// the registers of the avr/io.h shim (tools/replay/shim) and the globals main.cpp has
+// include it in one file of each test, before the tests
+#ifndef fake_avr_h
+#define fake_avr_h
+
+#include <avr/io.h>
+#include "reflowtoasteroven.h"
+
+volatile uint8_t ADCL, ADCH, ADMUX, ADCSRA, ADCSRB, DIDR0;
+volatile uint8_t PORTB, DDRB, PINB, PORTC, DDRC, PINC, PORTD, DDRD, PIND;
+uint8_t eeprom[E2END + 1];
+volatile uint16_t EEAR;
+volatile uint8_t EEDR;
+eecr_t EECR;
+
+settings_t settings;
+
+#endif
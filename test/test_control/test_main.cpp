@@ -0,0 +1,158 @@
+// pid() and the stages of reflow_step(), see reflowcontrol.cpp
+
+#include <unity.h>
+#include <math.h>
+
+#include "../fake_avr.h"
+#include "reflowcontrol.h"
+
+static const double tick = TMR_OVF_TIMESPAN * 256; // seconds per check
+
+void setUp(void)
+{
+	settings_setdefault(&settings);
+	pid_init();
+}
+
+void tearDown(void)
+{
+}
+
+void test_pid_off_at_target_0(void)
+{
+	int32_t integral = 1000;
+	int16_t last_error = 50;
+	TEST_ASSERT_EQUAL_UINT16(0, pid(0, 200, &integral, &last_error, 0));
+	TEST_ASSERT_EQUAL_INT32(0, integral);
+	TEST_ASSERT_EQUAL_INT16(0, last_error);
+}
+
+void test_pid_proportional(void)
+{
+	settings.pid_p = settings.pid_p_hot = 2.0;
+	settings.pid_i = settings.pid_i_hot = 0.0;
+	settings.pid_d = settings.pid_d_hot = 0.0;
+	pid_init();
+
+	int32_t integral = 0;
+	int16_t last_error = 0;
+	TEST_ASSERT_EQUAL_UINT16(approx_pwm(1000) + 2 * 10, pid(1000, 990, &integral, &last_error, 0));
+	TEST_ASSERT_EQUAL_UINT16(approx_pwm(1000) - 2 * 10 + 100, pid(1000, 1010, &integral, &last_error, 100));
+}
+
+void test_pid_saturates(void)
+{
+	int32_t integral = 0;
+	int16_t last_error = 0;
+	TEST_ASSERT_EQUAL_UINT16(65535, pid(2000, 200, &integral, &last_error, 0));
+	integral = 0;
+	last_error = 0;
+	TEST_ASSERT_EQUAL_UINT16(0, pid(500, 3000, &integral, &last_error, 0));
+}
+
+// the integral does not grow while the output is at its limit, so it lets go as soon as the error turns
+void test_pid_no_windup(void)
+{
+	int32_t integral = 0;
+	int16_t last_error = 0;
+	for (int i = 0; i < 500; i++)
+	{
+		TEST_ASSERT_EQUAL_UINT16(65535, pid(2000, 200, &integral, &last_error, 0));
+	}
+	TEST_ASSERT_EQUAL_INT32(0, integral);
+
+	TEST_ASSERT_LESS_THAN(approx_pwm(2000), pid(2000, 2050, &integral, &last_error, 0));
+}
+
+// one segment of each kind the default profile does not have, on an oven that follows the target
+static void profile_short(profile_t *profile)
+{
+	profile_setdefault(profile);
+	segment_set(&profile->seg[0], SEGMENT_RAMP, 100.0, 2.0);
+	segment_set(&profile->seg[1], SEGMENT_HOLD, 100.0, 10.0);
+	segment_set(&profile->seg[2], SEGMENT_COOL, 50.0, 2.0);
+	segment_set(&profile->seg[3], SEGMENT_END, 0.0, 0.0);
+}
+
+void test_reflow_stages(void)
+{
+	profile_t profile;
+	reflow_t r;
+	profile_short(&profile);
+
+	int16_t temp = 200;
+	reflow_init(&r, &profile, temp);
+	TEST_ASSERT_EQUAL_INT(0, r.stage);
+	TEST_ASSERT_EQUAL_INT16(200, r.tgt_temp);
+
+	uint16_t checks[REFLOW_STAGE_DONE + 1] = {0};
+	char stage = r.stage;
+	for (int i = 0; i < 2000 && r.stage != REFLOW_STAGE_DONE; i++)
+	{
+		reflow_step(&r, temp);
+		TEST_ASSERT_TRUE(r.stage == stage || r.stage == stage + 1 || r.stage == REFLOW_STAGE_DONE);
+		stage = r.stage;
+		checks[(uint8_t)stage]++;
+		if (stage != REFLOW_STAGE_DONE)
+		{
+			TEST_ASSERT_LESS_OR_EQUAL(1000, r.tgt_temp);
+			temp = r.tgt_temp;
+		}
+		if (stage == 1)
+		{
+			TEST_ASSERT_EQUAL_INT16(1000, r.tgt_temp);
+		}
+	}
+	TEST_ASSERT_EQUAL_INT(REFLOW_STAGE_DONE, r.stage);
+	TEST_ASSERT_EQUAL_UINT16(0, r.pwm_ocr);
+	TEST_ASSERT_EQUAL_INT16(temperature_to_deci(ROOM_TEMP), r.tgt_temp);
+
+	// 80 C at 2 C/s, the hold to the whole second, 50 C at 2 C/s
+	TEST_ASSERT_FLOAT_WITHIN(8.0, 40.0, checks[0] * tick);
+	TEST_ASSERT_FLOAT_WITHIN(tick, 10.0, checks[1] * tick);
+	TEST_ASSERT_FLOAT_WITHIN(4.0, 25.0, checks[2] * tick);
+	TEST_ASSERT_LESS_THAN(500, temp);
+}
+
+// a ramp that starts above its temperature goes down to it
+void test_reflow_ramp_down(void)
+{
+	profile_t profile;
+	reflow_t r;
+	profile_short(&profile);
+
+	reflow_init(&r, &profile, 1500);
+	reflow_step(&r, 1500);
+	TEST_ASSERT_EQUAL_INT(0, r.stage);
+	TEST_ASSERT_LESS_THAN(1500, r.tgt_temp);
+	TEST_ASSERT_EQUAL_UINT16(0, r.pwm_ocr);
+}
+
+void test_reflow_heats_towards_target(void)
+{
+	profile_t profile;
+	reflow_t r;
+	profile_short(&profile);
+
+	reflow_init(&r, &profile, 200);
+	for (int i = 0; i < 10; i++)
+	{
+		reflow_step(&r, 200);
+	}
+	TEST_ASSERT_EQUAL_INT(0, r.stage);
+	TEST_ASSERT_GREATER_THAN(200, r.tgt_temp);
+	TEST_ASSERT_GREATER_THAN(approx_pwm(200), r.pwm_ocr);
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_pid_off_at_target_0);
+	RUN_TEST(test_pid_proportional);
+	RUN_TEST(test_pid_saturates);
+	RUN_TEST(test_pid_no_windup);
+	RUN_TEST(test_reflow_stages);
+	RUN_TEST(test_reflow_ramp_down);
+	RUN_TEST(test_reflow_heats_towards_target);
+	return UNITY_END();
+}
@@ -0,0 +1,60 @@
+// str_from_int(), str_from_fixed(), str_from_deci() and str_from_double(), see format.cpp
+
+#include <unity.h>
+#include <stdint.h>
+
+#include "../fake_avr.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_int(void)
+{
+	TEST_ASSERT_EQUAL_STRING("0", str_from_int(0));
+	TEST_ASSERT_EQUAL_STRING("-42", str_from_int(-42));
+	TEST_ASSERT_EQUAL_STRING("2147483647", str_from_int(INT32_MAX));
+}
+
+void test_fixed(void)
+{
+	TEST_ASSERT_EQUAL_STRING("1.234", str_from_fixed(1234, 3));
+	TEST_ASSERT_EQUAL_STRING("-0.004", str_from_fixed(-4, 3));
+	TEST_ASSERT_EQUAL_STRING("0.000", str_from_fixed(0, 3));
+	TEST_ASSERT_EQUAL_STRING("12", str_from_fixed(12, 0));
+	TEST_ASSERT_EQUAL_STRING("-2147483.648", str_from_fixed(INT32_MIN, 3));
+}
+
+void test_deci(void)
+{
+	TEST_ASSERT_EQUAL_STRING("217.5", str_from_deci(2175));
+	TEST_ASSERT_EQUAL_STRING("0.7", str_from_deci(7));
+	TEST_ASSERT_EQUAL_STRING("0.0", str_from_deci(0));
+	TEST_ASSERT_EQUAL_STRING("-0.5", str_from_deci(-5));
+	TEST_ASSERT_EQUAL_STRING("-12.0", str_from_deci(-120));
+}
+
+void test_double(void)
+{
+	TEST_ASSERT_EQUAL_STRING("217.5", str_from_double(217.5, 1));
+	TEST_ASSERT_EQUAL_STRING("-0.004", str_from_double(-0.004, 3));
+	TEST_ASSERT_EQUAL_STRING("0.0", str_from_double(0.0, 1));
+	TEST_ASSERT_EQUAL_STRING("-0.5", str_from_double(-0.5, 1));
+	TEST_ASSERT_EQUAL_STRING("409.200", str_from_double(409.2, GAIN_DECIMALS));
+	TEST_ASSERT_EQUAL_STRING("2.35", str_from_double(2.349, 2)); // rounded, not cut off
+	TEST_ASSERT_EQUAL_STRING("100", str_from_double(99.6, 0));
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_int);
+	RUN_TEST(test_fixed);
+	RUN_TEST(test_deci);
+	RUN_TEST(test_double);
+	return UNITY_END();
+}
@@ -0,0 +1,107 @@
+// heat_set() and the software PWM of heat_isr(), on the pin_heater bit of the PORTD shim, see heatingelement.cpp
+
+#include <unity.h>
+
+#include "../fake_avr.h"
+#include "board.h"
+#include "heatingelement.h"
+
+#define PWM_PERIOD 512 // heat_isr() calls
+
+static char heater_on()
+{
+	return (PORTD & _BV(6)) != 0;
+}
+
+// runs heat_isr() up to the start of a period, so a heat_set() before this has been taken
+static void period_start()
+{
+	for (int i = 0; i < PWM_PERIOD; i++)
+	{
+		heat_isr();
+	}
+}
+
+// calls of the next period with the heater on
+static int period_on()
+{
+	int on = 0;
+	for (int i = 0; i < PWM_PERIOD; i++)
+	{
+		heat_isr();
+		on += heater_on();
+	}
+	return on;
+}
+
+void setUp(void)
+{
+	heat_init();
+	heat_set(0);
+	period_start();
+}
+
+void tearDown(void)
+{
+}
+
+void test_init(void)
+{
+	TEST_ASSERT_TRUE((DDRD & _BV(6)) != 0);
+	TEST_ASSERT_FALSE(heater_on());
+}
+
+void test_off(void)
+{
+	TEST_ASSERT_EQUAL_INT(0, period_on());
+}
+
+void test_full(void)
+{
+	heat_set(65535);
+	period_start();
+	TEST_ASSERT_EQUAL_INT(PWM_PERIOD, period_on());
+}
+
+void test_duty_cycle(void)
+{
+	heat_set(32768);
+	period_start();
+	TEST_ASSERT_INT_WITHIN(1, PWM_PERIOD / 2, period_on());
+
+	heat_set(8192);
+	period_start();
+	TEST_ASSERT_INT_WITHIN(1, PWM_PERIOD / 8, period_on());
+
+	heat_set(127); // less than a step of heat_set()
+	period_start();
+	TEST_ASSERT_EQUAL_INT(0, period_on());
+}
+
+// the heater is switched on at the start of a period, a new duty cycle waits for the next one
+void test_period_start(void)
+{
+	heat_set(65535);
+	for (int i = 0; i < PWM_PERIOD - 1; i++)
+	{
+		heat_isr();
+		TEST_ASSERT_FALSE(heater_on());
+	}
+	heat_isr();
+	TEST_ASSERT_TRUE(heater_on());
+
+	heat_set(0);
+	heat_isr();
+	TEST_ASSERT_TRUE(heater_on());
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_init);
+	RUN_TEST(test_off);
+	RUN_TEST(test_full);
+	RUN_TEST(test_duty_cycle);
+	RUN_TEST(test_period_start);
+	return UNITY_END();
+}
@@ -0,0 +1,233 @@
+// the records in EEPROM: settings, profiles, calibration and the run counter, see nvm.cpp
+// the EEPROM is the array of the avr/io.h shim, erased it is all 0xFF
+
+#include <unity.h>
+#include <string.h>
+
+#include "../fake_avr.h"
+#include "nvm.h"
+
+static void eeprom_erase()
+{
+	memset(eeprom, 0xFF, sizeof(eeprom));
+}
+
+// a block of the firmware before the records, followed by its XOR checksum
+static void legacy_write(uint16_t addr, const void *data, uint8_t size)
+{
+	uint8_t checksum = 0;
+	for (uint8_t i = 0; i < size; i++)
+	{
+		eeprom[addr + i] = ((const uint8_t *)data)[i];
+		checksum ^= eeprom[addr + i];
+	}
+	eeprom[addr + size] = checksum;
+}
+
+static void legacy_put(uint8_t **p, const void *data, uint8_t size)
+{
+	memcpy(*p, data, size);
+	*p += size;
+}
+
+// the profile of fixed stages, as the AVR laid it out
+static uint8_t legacy_profile(uint8_t *block, float soak_temp1, float peak_temp)
+{
+	float start_rate = 1.5, soak_temp2 = soak_temp1 + 30.0, cool_rate = 3.0;
+	uint16_t soak_length = 60, time_to_peak = 40;
+	uint8_t *p = block;
+	legacy_put(&p, &start_rate, 4);
+	legacy_put(&p, &soak_temp1, 4);
+	legacy_put(&p, &soak_temp2, 4);
+	legacy_put(&p, &soak_length, 2);
+	legacy_put(&p, &peak_temp, 4);
+	legacy_put(&p, &time_to_peak, 2);
+	legacy_put(&p, &cool_rate, 4);
+	return p - block;
+}
+
+void setUp(void)
+{
+	eeprom_erase();
+}
+
+void tearDown(void)
+{
+}
+
+void test_settings_fresh(void)
+{
+	settings_t s, expected;
+	settings_setdefault(&expected);
+	settings_load(&s);
+	TEST_ASSERT_EQUAL_MEMORY(&expected, &s, sizeof(settings_t));
+	TEST_ASSERT_EQUAL_HEX8(0x5A, eeprom[0]); // saved as a record
+}
+
+void test_settings_round_trip(void)
+{
+	settings_t s, loaded;
+	settings_setdefault(&s);
+	s.pid_p = 123.5;
+	s.pid_d = -0.004;
+	s.max_temp = 240.0;
+	s.sched_high = 220.0;
+	settings_save(&s);
+	settings_load(&loaded);
+	TEST_ASSERT_EQUAL_MEMORY(&s, &loaded, sizeof(settings_t));
+}
+
+void test_settings_bad_crc(void)
+{
+	settings_t s, loaded, expected;
+	settings_setdefault(&s);
+	s.pid_p = 123.5;
+	settings_save(&s);
+	eeprom[5] ^= 0x01;
+	settings_load(&loaded);
+	settings_setdefault(&expected);
+	TEST_ASSERT_EQUAL_MEMORY(&expected, &loaded, sizeof(settings_t));
+}
+
+// gains of a record that are over GAIN_LIMIT are kept as close as they can be
+void test_settings_clamped(void)
+{
+	settings_t s, loaded;
+	settings_setdefault(&s);
+	s.pid_p = 2000.0;
+	s.max_temp = 240.0;
+	settings_save(&s);
+	settings_load(&loaded);
+	TEST_ASSERT_EQUAL_FLOAT(GAIN_LIMIT, loaded.pid_p);
+	TEST_ASSERT_EQUAL_FLOAT(240.0, loaded.max_temp);
+}
+
+void test_profile_round_trip(void)
+{
+	profile_t p, loaded;
+	profile_select(1);
+	profile_setdefault(&p);
+	segment_set(&p.seg[2], SEGMENT_RAMP_TIME, 230.0, 50.0);
+	segment_set(&p.seg[5], SEGMENT_HOLD, 60.0, 30.0);
+	profile_save(&p);
+	profile_load(&loaded);
+	TEST_ASSERT_EQUAL_MEMORY(&p, &loaded, sizeof(profile_t));
+	TEST_ASSERT_TRUE(profile_slot_valid(1));
+	TEST_ASSERT_FALSE(profile_slot_valid(2));
+	TEST_ASSERT_EQUAL_UINT8(1, profile_selected());
+
+	profile_select(0);
+	profile_setdefault(&p);
+	profile_load(&loaded);
+	TEST_ASSERT_EQUAL_MEMORY(&p, &loaded, sizeof(profile_t)); // never saved, the default
+}
+
+void test_profile_invalid(void)
+{
+	profile_t p, loaded, expected;
+	profile_select(2);
+	profile_setdefault(&p);
+	p.seg[1].temp = SEGMENT_TEMP_MAX + 1;
+	profile_save(&p);
+	profile_load(&loaded);
+	profile_setdefault(&expected);
+	TEST_ASSERT_EQUAL_MEMORY(&expected, &loaded, sizeof(profile_t));
+}
+
+void test_profile_name(void)
+{
+	char name[PROFILE_NAME_SIZE + 1];
+	profile_name(3, name);
+	TEST_ASSERT_EQUAL_STRING("Profile 4", name);
+	profile_rename(3, "Lead free");
+	profile_name(3, name);
+	TEST_ASSERT_EQUAL_STRING("Lead free", name);
+}
+
+void test_calibration_round_trip(void)
+{
+	calibration_t cal, loaded;
+	calibration_setdefault(&cal);
+	cal.offset = -15;
+	cal.temp[3] += 20;
+	calibration_save(&cal);
+	calibration_load(&loaded);
+	TEST_ASSERT_EQUAL_MEMORY(&cal, &loaded, sizeof(calibration_t));
+}
+
+void test_calibration_invalid(void)
+{
+	calibration_t cal, loaded, expected;
+	calibration_setdefault(&cal);
+	cal.raw[2] = cal.raw[1]; // has to rise
+	calibration_save(&cal);
+	calibration_load(&loaded);
+	calibration_setdefault(&expected);
+	TEST_ASSERT_EQUAL_MEMORY(&expected, &loaded, sizeof(calibration_t));
+}
+
+void test_runs(void)
+{
+	uint16_t runs = nvm_runs();
+	for (int i = 0; i < 3 * NVM_STATE_ENTRIES; i++)
+	{
+		nvm_count_run();
+	}
+	TEST_ASSERT_EQUAL_UINT16(runs + 3 * NVM_STATE_ENTRIES, nvm_runs());
+	TEST_ASSERT_FALSE(nvm_busy());
+}
+
+// the XOR checksummed blocks of older firmware, gains per AD595 count and no gain schedule yet
+void test_legacy(void)
+{
+	float old[5] = {1500.0, 6.0, -0.01, 235.0, 210.0};
+	uint8_t block[32];
+	legacy_write(0, old, sizeof(old));
+	legacy_write(2 + sizeof(old), block, legacy_profile(block, 140.0, 225.0));
+
+	settings_t s;
+	settings_load(&s);
+	TEST_ASSERT_FLOAT_WITHIN(0.01, 1500.0 * 0.1 / THERMOCOUPLE_CONSTANT, s.pid_p);
+	TEST_ASSERT_FLOAT_WITHIN(0.01, 1500.0 * 0.1 / THERMOCOUPLE_CONSTANT, s.pid_p_hot);
+	TEST_ASSERT_EQUAL_FLOAT(235.0, s.max_temp);
+
+	profile_t p;
+	profile_select(0);
+	profile_load(&p);
+	TEST_ASSERT_EQUAL_INT16(1400, p.seg[0].temp);
+	TEST_ASSERT_EQUAL_INT16(2250, p.seg[2].temp);
+	TEST_ASSERT_EQUAL_UINT16(60, p.seg[1].value);
+	TEST_ASSERT_EQUAL_HEX8(0x5A, eeprom[0]); // records from now on
+}
+
+// gains that were over GAIN_LIMIT once they are per 0.1 C
+void test_legacy_clamped(void)
+{
+	float old[10] = {6000.0, 6.0, -0.01, 235.0, 210.0, 900.0, 3.0, -0.03, 160.0, 210.0};
+	legacy_write(0, old, sizeof(old));
+
+	settings_t s;
+	settings_load(&s);
+	TEST_ASSERT_EQUAL_FLOAT(GAIN_LIMIT, s.pid_p);
+	TEST_ASSERT_FLOAT_WITHIN(0.01, 900.0 * 0.1 / THERMOCOUPLE_CONSTANT, s.pid_p_hot);
+	TEST_ASSERT_EQUAL_FLOAT(235.0, s.max_temp);
+	TEST_ASSERT_EQUAL_FLOAT(160.0, s.sched_low);
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_settings_fresh);
+	RUN_TEST(test_settings_round_trip);
+	RUN_TEST(test_settings_bad_crc);
+	RUN_TEST(test_settings_clamped);
+	RUN_TEST(test_profile_round_trip);
+	RUN_TEST(test_profile_invalid);
+	RUN_TEST(test_profile_name);
+	RUN_TEST(test_calibration_round_trip);
+	RUN_TEST(test_calibration_invalid);
+	RUN_TEST(test_runs);
+	RUN_TEST(test_legacy);
+	RUN_TEST(test_legacy_clamped);
+	return UNITY_END();
+}
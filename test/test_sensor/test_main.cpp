@@ -0,0 +1,148 @@
+// the AD595 filter and sensor_read(), fed through the ADC interrupt, see temperaturemeasurement.cpp
+// with SENSOR_CHANNELS 2 ([env:native_air]) also how the two thermocouples are combined
+
+#include <unity.h>
+#include <string.h>
+
+#include "../fake_avr.h"
+#include "temperaturemeasurement.h"
+
+#define SAMPLES 128 // fills the filter, ADC_SAMPLE_SIZE of every channel
+
+// what the ADC of each channel converts next
+static uint16_t adc_value[2];
+static uint16_t adc_trough[2];
+static uint8_t adc_run; // samples at the crest, then as many in the trough, 0 for a steady value
+
+static void adc_feed(int samples)
+{
+	for (int i = 0; i < samples * SENSOR_CHANNELS; i++)
+	{
+		uint8_t channel = (ADMUX & 0x0F) == TEMP_AIR_CHAN;
+		uint16_t value = adc_run != 0 && (i / SENSOR_CHANNELS / adc_run) % 2 ? adc_trough[channel] : adc_value[channel];
+		ADCL = value & 0xFF;
+		ADCH = value >> 8;
+		ADC_vect();
+	}
+}
+
+static void adc_set(uint16_t value, uint16_t air)
+{
+	adc_value[0] = value;
+	adc_value[1] = air;
+	adc_run = 0;
+}
+
+// what sensor_read() gets from counts on the ADC, from the start
+static int16_t steady_reading(uint16_t counts)
+{
+	adc_set(counts, counts);
+	adc_feed(SAMPLES);
+	sensor_filter_reset();
+	return sensor_read();
+}
+
+void setUp(void)
+{
+	sensor_init();
+	adc_set(0, 0);
+	adc_feed(SAMPLES);
+	sensor_filter_reset();
+}
+
+void tearDown(void)
+{
+}
+
+void test_scale(void)
+{
+	calibration_t cal;
+	memcpy(&cal, &calibration_none, sizeof(calibration_t));
+	sensor_calibrate(&cal);
+
+	// THERMOCOUPLE_CONSTANT C per count
+	TEST_ASSERT_EQUAL_INT16(1999, steady_reading(409));
+	TEST_ASSERT_EQUAL_INT16(0, steady_reading(0));
+}
+
+// the AD595 sometimes puts out a square wave, the filter takes the crests
+void test_square_wave(void)
+{
+	int16_t steady = steady_reading(420);
+
+	adc_value[0] = adc_value[1] = 420;
+	adc_trough[0] = adc_trough[1] = 60;
+	adc_run = 5;
+	adc_feed(SAMPLES);
+	sensor_filter_reset();
+	TEST_ASSERT_EQUAL_INT16(steady, sensor_read());
+}
+
+// a reading can only drop 5 counts at a time
+void test_falls_slowly(void)
+{
+	steady_reading(400);
+	adc_set(300, 300);
+	adc_feed(SAMPLES);
+	int16_t first = sensor_read();
+	int16_t second = sensor_read();
+
+	TEST_ASSERT_EQUAL_INT16(steady_reading(395), first);
+	TEST_ASSERT_EQUAL_INT16(steady_reading(390), second);
+}
+
+void test_rises_at_once(void)
+{
+	steady_reading(300);
+	adc_set(400, 400);
+	adc_feed(SAMPLES);
+	int16_t reading = sensor_read();
+	TEST_ASSERT_EQUAL_INT16(steady_reading(400), reading);
+}
+
+void test_reset(void)
+{
+	steady_reading(400);
+	adc_set(300, 300);
+	adc_feed(SAMPLES);
+	sensor_filter_reset();
+	int16_t reading = sensor_read();
+	TEST_ASSERT_EQUAL_INT16(steady_reading(300), reading);
+}
+
+#if SENSOR_CHANNELS > 1
+void test_channels(void)
+{
+	int16_t board = steady_reading(400);
+	int16_t air = steady_reading(200);
+
+	adc_set(400, 200);
+	adc_feed(SAMPLES);
+	sensor_filter_reset();
+	int16_t combined = sensor_read();
+	TEST_ASSERT_EQUAL_INT16(board, sensor_read_channel(0));
+	TEST_ASSERT_EQUAL_INT16(air, sensor_read_channel(1));
+	if (SENSOR_MIX == SENSOR_MIX_MAX)
+	{
+		TEST_ASSERT_EQUAL_INT16(board, combined);
+	}
+	else
+	{
+		TEST_ASSERT_INT_WITHIN(1, board + (air - board) * SENSOR_MIX, combined);
+	}
+}
+#endif
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_scale);
+	RUN_TEST(test_square_wave);
+	RUN_TEST(test_falls_slowly);
+	RUN_TEST(test_rises_at_once);
+	RUN_TEST(test_reset);
+#if SENSOR_CHANNELS > 1
+	RUN_TEST(test_channels);
+#endif
+	return UNITY_END();
+}
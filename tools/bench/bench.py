@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Cycle counts of the firmware hot paths on simavr, see src/bench.cpp.
+
+Builds [env:bench] with PlatformIO (unless --no-build), runs it on simavr as an ATmega328 at
+8 MHz and prints the cycles per call of each path. The most cycles of a path are compared
+with its limit in limits.ini, more than the limit is a regression and makes the exit status 1.
+A path without a limit can not be checked and makes the exit status 2, like a failed build or
+simulation, so the check neither passes nor reports a regression before the limits are recorded.
+
+Examples:
+    bench.py                     # build, run, compare
+    bench.py --update            # record the current counts plus --margin as the limits
+    bench.py --elf firmware.elf --simavr ~/simavr/simavr/run_avr
+
+limits.ini looks like this, overhead needs no limit:
+    [limits]
+    pid = 700
+    auto_draw = 220000
+"""
+
+import argparse
+import configparser
+import os
+import re
+import subprocess
+import sys
+
+ROOT = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", ".."))
+ELF = os.path.join(ROOT, ".pio", "build", "bench", "firmware.elf")
+LIMITS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "limits.ini")
+ESCAPE = re.compile(r"\x1b\[[0-9;]*m")  # simavr colours the UART output
+
+
+class BenchError(Exception):
+    pass
+
+
+def build():
+    if subprocess.call(["pio", "run", "-e", "bench"], cwd=ROOT) != 0:
+        raise BenchError("pio run -e bench failed")
+
+
+def run(simavr, elf, timeout):
+    """Return {name: (fewest, most)} from the "bench, ..." lines the firmware prints."""
+    try:
+        proc = subprocess.run([simavr, "-m", "atmega328p", "-f", "8000000", elf], stdout=subprocess.PIPE,
+                              stderr=subprocess.STDOUT, text=True, errors="replace", timeout=timeout)
+    except FileNotFoundError:
+        raise BenchError("%s not found, install simavr or give --simavr" % simavr)
+    except subprocess.TimeoutExpired:
+        raise BenchError("no \"bench done\" within %g s" % timeout)
+    results = {}
+    done = False
+    for line in proc.stdout.splitlines():
+        line = ESCAPE.sub("", line)
+        if "bench done," in line:
+            done = True
+        match = re.search(r"bench, (\w+), (\d+), (\d+),", line)
+        if match:
+            results[match.group(1)] = (int(match.group(2)), int(match.group(3)))
+    if not done:
+        raise BenchError("the firmware did not finish:\n" + proc.stdout)
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--elf", default=ELF, help="firmware built with BENCHMARK 1 (default %(default)s)")
+    parser.add_argument("--simavr", default="simavr", help="simavr executable (default %(default)s)")
+    parser.add_argument("--limits", default=LIMITS, help="limits file (default %(default)s)")
+    parser.add_argument("--no-build", action="store_true", help="use the .elf as it is")
+    parser.add_argument("--update", action="store_true", help="write the counts plus --margin to the limits file")
+    parser.add_argument("--margin", type=float, default=10.0, help="percent above the counts for --update")
+    parser.add_argument("--timeout", type=float, default=60.0, help="seconds the simulation may take")
+    args = parser.parse_args()
+
+    try:
+        if not args.no_build:
+            build()
+        results = run(args.simavr, args.elf, args.timeout)
+    except BenchError as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 2
+
+    config = configparser.ConfigParser()
+    config.read(args.limits)
+    if not config.has_section("limits"):
+        config.add_section("limits")
+    limits = config["limits"]
+
+    failed = 0
+    missing = 0
+    print("%-16s %8s %8s %8s" % ("path", "fewest", "most", "limit"))
+    for name, (fewest, most) in results.items():
+        limit = int(limits[name]) if name in limits else None
+        verdict = ""
+        if limit is None and name != "overhead":
+            verdict = "  NO LIMIT"
+            missing += 1
+        elif limit is not None and most > limit:
+            verdict = "  REGRESSION, %+.1f %%" % ((most - limit) * 100.0 / limit)
+            failed += 1
+        print("%-16s %8d %8d %8s%s" % (name, fewest, most, "-" if limit is None else limit, verdict))
+
+    if args.update:
+        for name, (fewest, most) in results.items():
+            if name != "overhead":
+                limits[name] = str(int(most * (1 + args.margin / 100.0) + 0.5))
+        with open(args.limits, "w") as f:
+            f.write("; most cycles per call, bench.py fails above these, written by bench.py --update\n")
+            config.write(f)
+        print("limits written to %s" % args.limits)
+        return 0
+    if failed:
+        return 1
+    if missing:
+        print("error: %d paths have no limit in %s, record them with --update on a known good build"
+              % (missing, args.limits), file=sys.stderr)
+        return 2
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
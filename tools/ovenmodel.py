@@ -0,0 +1,294 @@
+#!/usr/bin/env python3
+"""Fit a thermal model of the oven to manual PWM step tests.
+
+Reads the log of the manual PWM control mode (time, sensor, pwm), as captured with
+"reflowctl.py monitor", and fits a first or second order plus dead time model:
+
+    order 1:  tau1 * dT/dt = gain * u(t - dead_time) - (T - ambient)
+    order 2:  the same, followed by a second lag tau2 (element -> oven air -> thermocouple)
+
+u is the duty cycle from 0 to 1 and gain is how far above ambient the oven ends up at
+100 %. 1 / tau1 is the ambient loss: the part of the excess over ambient that leaks away
+per second. All manual PWM runs in the given files are fitted together, so a heating
+step and a cooling step in separate runs are fine. For a usable fit the oven has to
+heat for at least a few time constants; a couple of steps up and down is better still.
+
+The output file has a [model] section for "replay --simulate" (tools/replay) and a
+[settings] section with suggested values that "reflowctl.py apply" accepts:
+    max_temp     ambient + gain, the temperature 100 % duty cycle ends up at, which is
+                 what approx_pwm() assumes
+    time_to_max  max_temp / the heating rate at full power, so max_temp / time_to_max
+                 is the fastest the oven can heat
+    pid_*        SIMC PI tuning of the model, in the units pid() uses (PWM per 0.1 C,
+                 per control tick), the model is linear so the hot gains are the same
+
+Examples:
+    reflowctl.py -p COM3 pwm 65535; reflowctl.py -p COM3 monitor > step.txt
+    ovenmodel.py step.txt -o oven.ini
+    ovenmodel.py --order 2 step.txt cooldown.txt -o oven.ini
+"""
+
+import argparse
+import math
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from reflowstats import LOG_CONSTANT, runs_from_lines  # noqa: E402
+
+TICK = 0.002048 * 256  # TMR_OVF_TIMESPAN * 256, the pid() update interval in auto_go
+SETTINGS_FIELDS = ["pid_p", "pid_i", "pid_d", "max_temp", "time_to_max", "pid_p_hot", "pid_i_hot", "pid_d_hot"]
+
+
+class Series:
+    """One manual PWM run, times from 0, temperatures in C and the applied duty cycle."""
+
+    def __init__(self, run):
+        t0 = run.time[0]
+        self.time = [t - t0 for t in run.time]
+        self.temp = run.temp
+        # heat_set() only uses the top 9 bits
+        self.duty = [(int(p) >> 7) / 512.0 for p in run.pwm]
+
+    def duty_at(self, t):
+        """Duty cycle at time t, linear between samples so dead time is a smooth parameter."""
+        if t <= 0:
+            return 0.0  # the mode starts with the heater off
+        time = self.time
+        lo, hi = 0, len(time) - 1
+        if t >= time[hi]:
+            return self.duty[hi]
+        while hi - lo > 1:
+            mid = (lo + hi) // 2
+            if time[mid] <= t:
+                lo = mid
+            else:
+                hi = mid
+        f = (t - time[lo]) / (time[hi] - time[lo])
+        return self.duty[lo] + f * (self.duty[hi] - self.duty[lo])
+
+
+def simulate(series, gain, tau1, tau2, dead_time, ambient):
+    """Model response to the duty cycle of a run, starting at rest at its first temperature."""
+    t = series.time
+    element = oven = series.temp[0]
+    out = [oven]
+    for k in range(len(t) - 1):
+        dt = t[k + 1] - t[k]
+        u = series.duty_at(t[k] + dt / 2 - dead_time)
+        # exact step of a first order lag for an input held over dt
+        target = ambient + gain * u
+        element = target + (element - target) * math.exp(-dt / tau1)
+        if tau2 > 0:
+            oven = element + (oven - element) * math.exp(-dt / tau2)
+        else:
+            oven = element
+        out.append(oven)
+    return out
+
+
+def cost(series_list, params, order):
+    gain, tau1, tau2, dead_time, ambient = unpack(params, order)
+    if gain <= 0 or tau1 <= 1 or dead_time < 0 or (order == 2 and tau2 <= 0):
+        return float("inf")
+    err, n = 0.0, 0
+    for s in series_list:
+        for y, m in zip(s.temp, simulate(s, gain, tau1, tau2, dead_time, ambient)):
+            err += (y - m) ** 2
+            n += 1
+    return err / n
+
+
+def unpack(params, order):
+    if order == 1:
+        gain, tau1, dead_time, ambient = params
+        return gain, tau1, 0.0, dead_time, ambient
+    return tuple(params)
+
+
+def nelder_mead(f, x0, steps, iterations=1500):
+    points = [list(x0)]
+    for i, step in enumerate(steps):
+        p = list(x0)
+        p[i] += step
+        points.append(p)
+    values = [f(p) for p in points]
+    n = len(x0)
+    for _ in range(iterations):
+        order = sorted(range(n + 1), key=values.__getitem__)
+        points = [points[i] for i in order]
+        values = [values[i] for i in order]
+        centroid = [sum(p[i] for p in points[:-1]) / n for i in range(n)]
+        worst = points[-1]
+
+        def towards(scale):
+            return [c + scale * (w - c) for c, w in zip(centroid, worst)]
+
+        reflected = towards(-1.0)
+        fr = f(reflected)
+        if fr < values[0]:
+            expanded = towards(-2.0)
+            fe = f(expanded)
+            points[-1], values[-1] = (expanded, fe) if fe < fr else (reflected, fr)
+        elif fr < values[-2]:
+            points[-1], values[-1] = reflected, fr
+        else:
+            contracted = towards(0.5)
+            fc = f(contracted)
+            if fc < values[-1]:
+                points[-1], values[-1] = contracted, fc
+            else:
+                # shrink towards the best point
+                best = points[0]
+                points = [best] + [[b + 0.5 * (p - b) for b, p in zip(best, q)] for q in points[1:]]
+                values = [values[0]] + [f(p) for p in points[1:]]
+        if max(values) - min(values) < 1e-9 * (1 + abs(values[0])):
+            break
+    best = min(range(n + 1), key=values.__getitem__)
+    return points[best], values[best]
+
+
+def initial_guess(series_list):
+    """First order estimate by linear least squares on the heating rate, dead time 0."""
+    # rows of dT/dt = a * T + b * u + c, over 5 sample differences to get past the quantization
+    ata = [[0.0] * 3 for _ in range(3)]
+    atb = [0.0] * 3
+    for s in series_list:
+        for k in range(len(s.time) - 5):
+            dt = s.time[k + 5] - s.time[k]
+            if dt <= 0:
+                continue
+            row = [s.temp[k], s.duty[k], 1.0]
+            rate = (s.temp[k + 5] - s.temp[k]) / dt
+            for i in range(3):
+                atb[i] += row[i] * rate
+                for j in range(3):
+                    ata[i][j] += row[i] * row[j]
+    ambient = sum(s.temp[0] for s in series_list) / len(series_list)
+    try:
+        a, b, c = solve(ata, atb)
+    except ZeroDivisionError:
+        a = b = 0.0
+    if a < 0 and b > 0:
+        tau = -1.0 / a
+        return b * tau, tau, c * tau
+    # not enough excitation for the estimate, fall back to a typical toaster oven
+    return 250.0, 200.0, ambient
+
+
+def solve(a, b):
+    n = len(b)
+    m = [row[:] + [v] for row, v in zip(a, b)]
+    for i in range(n):
+        pivot = max(range(i, n), key=lambda r: abs(m[r][i]))
+        m[i], m[pivot] = m[pivot], m[i]
+        if abs(m[i][i]) < 1e-12:
+            raise ZeroDivisionError
+        for r in range(n):
+            if r != i:
+                f = m[r][i] / m[i][i]
+                m[r] = [x - f * y for x, y in zip(m[r], m[i])]
+    return [m[i][n] / m[i][i] for i in range(n)]
+
+
+def fit(series_list, order):
+    gain, tau, ambient = initial_guess(series_list)
+    best = None
+    # the dead time makes the cost bumpy, start from a few and keep the best
+    for dead_time in (2.0, 10.0, 30.0):
+        if order == 1:
+            x0 = [gain, tau, dead_time, ambient]
+            steps = [gain * 0.2, tau * 0.2, 5.0, 2.0]
+        else:
+            x0 = [gain, tau * 0.8, tau * 0.2, dead_time, ambient]
+            steps = [gain * 0.2, tau * 0.2, tau * 0.1, 5.0, 2.0]
+        params, value = nelder_mead(lambda p: cost(series_list, p, order), x0, steps)
+        if best is None or value < best[1]:
+            best = (params, value)
+    gain, tau1, tau2, dead_time, ambient = unpack(best[0], order)
+    return {"order": order, "gain": gain, "tau1": tau1, "tau2": tau2,
+            "dead_time": dead_time, "ambient": ambient, "rms": math.sqrt(best[1])}
+
+
+def suggest_settings(model):
+    max_temp = model["ambient"] + model["gain"]
+    heat_rate = model["gain"] / model["tau1"]  # C/s at full power, from ambient
+
+    # SIMC PI tuning, a second lag is folded into the first one and the dead time with the
+    # half rule, derivative action only amplifies the quantization of the sensor
+    process_gain = model["gain"] * 10 / 65535.0  # 0.1 C per PWM step
+    tau = model["tau1"] + model["tau2"] / 2
+    dead_time = max(model["dead_time"] + model["tau2"] / 2, TICK)
+    kc = tau / (process_gain * 2 * dead_time)
+    ti = min(tau, 8 * dead_time)
+    return {
+        "pid_p": kc,
+        "pid_i": kc * TICK / ti,  # pid() adds the error once per tick
+        "pid_d": 0.0,
+        "pid_p_hot": kc,
+        "pid_i_hot": kc * TICK / ti,
+        "pid_d_hot": 0.0,
+        "max_temp": max_temp,
+        "time_to_max": max_temp / heat_rate,
+    }
+
+
+def predictor_dead_time(model):
+    """Dead time for the first order model of the peak predictor (src/reflowcontrol.cpp).
+
+    Found by simulation: the dead time plus a quarter of a second lag lands the peak on
+    target, a first order fit puts both lags in its dead time so half of that is used.
+    Too short overshoots a little, too long stops short of the peak, so this rounds down.
+    """
+    if model["order"] == 2:
+        return math.floor(model["dead_time"] + model["tau2"] / 4)
+    return math.floor(model["dead_time"] / 2)
+
+
+def write_file(f, sources, model, settings):
+    f.write("; oven model fitted by ovenmodel.py from %s\n" % ", ".join(sources))
+    f.write("; ambient loss %.5f /s, heating rate at full power %.3f C/s, rms fit error %.2f C\n"
+            % (1.0 / model["tau1"], model["gain"] / model["tau1"], model["rms"]))
+    f.write("[model]\n")
+    f.write("order = %d\n" % model["order"])
+    for key in ("gain", "tau1", "tau2", "dead_time", "ambient"):
+        f.write("%s = %.6g\n" % (key, model[key]))
+    f.write("\n; OVEN_DEAD_TIME for the peak predictor in reflowtoasteroven.h: %.0f\n" % predictor_dead_time(model))
+    f.write("\n; suggested, try these with replay --simulate before writing them to the oven\n")
+    f.write("[settings]\n")
+    for key in SETTINGS_FIELDS:
+        f.write("%s = %.6g\n" % (key, settings[key]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("files", nargs="+", help="captured logs with manual PWM runs")
+    parser.add_argument("--order", type=int, choices=[1, 2], default=1, help="model order, default 1")
+    parser.add_argument("--constant", type=float, default=LOG_CONSTANT, help="C per logged unit, 0.48876 for older logs in sensor counts")
+    parser.add_argument("-o", "--output", help="write the model and settings to this file instead of stdout")
+    args = parser.parse_args()
+
+    series_list = []
+    for path in args.files:
+        with open(path, errors="replace") as f:
+            for run in runs_from_lines(f, args.constant):
+                if run.mode == "pwm" and len(run.time) > 10:
+                    series_list.append(Series(run))
+    if not series_list:
+        sys.exit("no manual PWM runs found")
+    if all(max(s.duty) == 0 for s in series_list):
+        sys.exit("the heater was never on, nothing to fit")
+
+    model = fit(series_list, args.order)
+    settings = suggest_settings(model)
+    if args.output:
+        with open(args.output, "w") as f:
+            write_file(f, args.files, model, settings)
+    else:
+        write_file(sys.stdout, args.files, model, settings)
+    print("%d runs, %d samples, rms error %.2f C" % (len(series_list), sum(len(s.time) for s in series_list),
+                                                   model["rms"]), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
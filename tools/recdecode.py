@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""Decode the run recording dumped by the "dump" serial command (see src/recorder.cpp).
+
+Reads the "rec, <hex>" lines from a file or stdin, other lines are ignored, and prints
+CSV in the same columns as the auto_go log, without the pwm column:
+    stage, time, temperature, target temperature
+
+Examples:
+    reflowctl.py -p COM3 dump | recdecode.py > lastrun.csv
+    recdecode.py capture.txt
+"""
+
+import argparse
+import sys
+
+REC_MAGIC = 0x58
+REC_STAGES = 9  # PROFILE_SEGMENTS + 1
+REC_ESCAPE = 0x8
+REC_END = 0xFFF
+REC_UNIT = 0.5  # C per recorded value, REC_SCALE in include/recorder.h
+
+
+def parse_dump(lines):
+    data = bytearray()
+    for line in lines:
+        parts = [p.strip() for p in line.split(",")]
+        if parts and parts[0] == "rec":
+            data += bytes.fromhex("".join(parts[1:]))
+    return bytes(data)
+
+
+def decode(data):
+    """Return (tick_seconds, interval, stage_start, [(temperature, setpoint), ...], ended) in recorded values.
+
+    ended is False if the stream has no end marker, see recorder.cpp, the last samples are then garbage.
+    """
+    header_size = 4 + 2 * REC_STAGES
+    if len(data) < header_size or data[0] != REC_MAGIC:
+        raise ValueError("no recording found")
+    interval = data[1]
+    tick = int.from_bytes(data[2:4], "little") / 1000.0
+    stage_start = [int.from_bytes(data[4 + 2 * i:6 + 2 * i], "little") for i in range(REC_STAGES)]
+
+    nibbles = []
+    for b in data[header_size:]:
+        nibbles += [b >> 4, b & 0x0F]
+
+    values = []
+    last = [0, 0]
+    pos = 0
+    ended = False
+    while pos < len(nibbles):
+        which = len(values) % 2
+        n = nibbles[pos]
+        if n == REC_ESCAPE:
+            if pos + 4 > len(nibbles):
+                break
+            value = (nibbles[pos + 1] << 8) | (nibbles[pos + 2] << 4) | nibbles[pos + 3]
+            pos += 4
+            if value == REC_END:
+                ended = True
+                break
+        else:
+            value = last[which] + (n - 16 if n & 0x8 else n)
+            pos += 1
+        last[which] = value
+        values.append(value)
+
+    samples = list(zip(values[0::2], values[1::2]))
+    return tick, interval, stage_start, samples, ended
+
+
+def stage_of(index, stage_start):
+    stage = 0
+    for s, start in enumerate(stage_start):
+        if start != 0xFFFF and index >= start:
+            stage = s
+    return stage
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("file", nargs="?", help="captured dump, default stdin")
+    args = parser.parse_args()
+
+    with (open(args.file) if args.file else sys.stdin) as f:
+        data = parse_dump(f)
+    try:
+        tick, interval, stage_start, samples, ended = decode(data)
+    except ValueError as e:
+        sys.exit(str(e))
+    if not ended:
+        print("warning: no end marker, the power went while a sample was written, the last samples are garbage",
+              file=sys.stderr)
+
+    for i, (temp, setpoint) in enumerate(samples):
+        time = i * interval * tick
+        print("%d, %.1f, %.1f, %.1f," % (stage_of(i, stage_start), time, temp * REC_UNIT, setpoint * REC_UNIT))
+
+
+if __name__ == "__main__":
+    main()
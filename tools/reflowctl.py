@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+"""Host side of the serial command interface in src/serialcmd.cpp.
+
+Talks to an oven over a serial port (needs pyserial, which comes with PlatformIO),
+or to any program speaking the same protocol on stdin/stdout with --exec.
+
+Examples:
+    reflowctl.py -p COM3 settings
+    reflowctl.py -p COM3 -p COM4 -p COM5 apply oven.ini     # configure several ovens at once
+    reflowctl.py -p COM3 slot 2                             # select profile slot 2
+    reflowctl.py -p COM3 start
+    reflowctl.py -p COM3 monitor > run.csv
+    reflowctl.py -p COM3 dump | recdecode.py > lastrun.csv
+    reflowctl.py --exec ./oven_sim settings
+
+The file for "apply" looks like this, both sections are optional:
+    [settings]
+    pid_p = 409.2
+    pid_i = 1.023
+    pid_d = -0.004
+    max_temp = 230
+    time_to_max = 220
+    pid_p_hot = 409.2
+    pid_i_hot = 1.023
+    pid_d_hot = -0.004
+    sched_low = 150
+    sched_high = 217.5
+
+    [profile]
+    slot = 2                  ; optional, the profile slot to select and write, 1 to 4
+    name = SnPb               ; optional, renames the slot
+    1 = ramp 150 1            ; to 150 C at 1 C/s
+    2 = ramp_time 185 70      ; to 185 C in 70 s
+    3 = ramp_time 217.5 45
+    4 = wait 217.5 5          ; aim 5 C past 217.5 C until the oven gets there
+    5 = cool 25 2             ; down to 25 C at 2 C/s
+
+A [profile] section replaces the whole profile, numbered from 1 without gaps, up to 8
+segments. The types are in SEGMENT_TYPES, see include/reflowtoasteroven.h for what they do.
+"""
+
+import argparse
+import configparser
+import subprocess
+import sys
+import time
+
+SETTINGS_FIELDS = ["pid_p", "pid_i", "pid_d", "max_temp", "time_to_max",
+                   "pid_p_hot", "pid_i_hot", "pid_d_hot", "sched_low", "sched_high"]
+SEGMENT_TYPES = ["end", "ramp", "ramp_time", "hold", "wait", "cool"]  # SEGMENT_* in reflowtoasteroven.h
+PROFILE_SEGMENTS = 8
+SEGMENT_TEMP_MAX = 350.0  # C, SEGMENT_TEMP_MAX in reflowtoasteroven.h is in 0.1 C
+PROFILE_SLOTS = 4
+PROFILE_NAME_SIZE = 10
+
+
+class OvenError(Exception):
+    pass
+
+
+class SerialTransport:
+    def __init__(self, port, baud):
+        try:
+            import serial
+        except ImportError:
+            sys.exit("pyserial is needed for serial ports: pip install pyserial")
+        self.name = port
+        self.conn = serial.Serial(port, baud, timeout=0.2)
+
+    def write_line(self, line):
+        self.conn.write((line + "\n").encode("ascii"))
+
+    def read_line(self):
+        return self.conn.readline().decode("ascii", "replace").strip()
+
+    def close(self):
+        self.conn.close()
+
+
+class ProcessTransport:
+    def __init__(self, command):
+        self.name = command
+        self.proc = subprocess.Popen(command, shell=True, stdin=subprocess.PIPE,
+                                     stdout=subprocess.PIPE, text=True, bufsize=1)
+
+    def write_line(self, line):
+        self.proc.stdin.write(line + "\n")
+        self.proc.stdin.flush()
+
+    def read_line(self):
+        line = self.proc.stdout.readline()
+        if line == "" and self.proc.poll() is not None:
+            raise OvenError("simulator exited")
+        return line.strip()
+
+    def close(self):
+        self.proc.stdin.close()
+        self.proc.wait()
+
+
+class Oven:
+    def __init__(self, transport, timeout):
+        self.transport = transport
+        self.timeout = timeout
+
+    def command(self, line):
+        """Send one command line, return the response lines before "ok,".
+
+        CSV log lines (starting with a digit) and status messages that are not part of the
+        response are skipped.
+        """
+        self.transport.write_line(line)
+        deadline = time.monotonic() + self.timeout
+        response = []
+        while time.monotonic() < deadline:
+            reply = self.transport.read_line()
+            if not reply or reply[0].isdigit():
+                continue
+            if reply == "ok,":
+                return response
+            if reply.startswith("err,"):
+                raise OvenError("%s: %s" % (line, reply[4:].strip(" ,")))
+            response.append(reply)
+        raise OvenError("%s: no response from %s" % (line, self.transport.name))
+
+    def read_values(self, name, fields):
+        for reply in self.command(name):
+            parts = [p.strip() for p in reply.split(",") if p.strip()]
+            if parts and parts[0] == name:
+                return dict(zip(fields, (float(v) for v in parts[1:])))
+        raise OvenError("%s: unexpected response" % name)
+
+    def write_values(self, name, fields, values):
+        self.command(" ".join([name] + ["%g" % values[f] for f in fields]))
+
+    def read_profile(self):
+        """Return the segments as (type name, temperature, value)."""
+        for reply in self.command("profile"):
+            parts = [p.strip() for p in reply.split(",") if p.strip()]
+            if parts and parts[0] == "profile":
+                values = [float(v) for v in parts[1:]]
+                return [(SEGMENT_TYPES[int(values[i])], values[i + 1], values[i + 2])
+                        for i in range(0, len(values) - 2, 3)]
+        raise OvenError("profile: unexpected response")
+
+    def read_slots(self, slot=None):
+        """Select a slot if given, return the selected slot and the names of all slots."""
+        for reply in self.command("slot" if slot is None else "slot %d" % slot):
+            parts = [p.strip() for p in reply.split(",")]
+            if parts and parts[0] == "slot":
+                return int(parts[1]), parts[2:2 + PROFILE_SLOTS]
+        raise OvenError("slot: unexpected response")
+
+    def write_profile(self, segments):
+        self.command(" ".join(["profile"] + ["%d %g %g" % (SEGMENT_TYPES.index(t), temp, value)
+                                             for t, temp, value in segments]))
+
+
+def print_values(oven, name, values):
+    print("[%s] %s" % (oven.transport.name, name))
+    for field, value in values.items():
+        print("  %-13s %g" % (field, value))
+
+
+def print_profile(oven, segments):
+    print("[%s] profile" % oven.transport.name)
+    for number, (type_name, temp, value) in enumerate(segments, 1):
+        print("  %d %-10s %6g %g" % (number, type_name, temp, value))
+
+
+def print_slots(oven, selected, names):
+    print("[%s] slots" % oven.transport.name)
+    for number, name in enumerate(names, 1):
+        print("  %s%d %s" % ("*" if number == selected else " ", number, name))
+
+
+def profile_from_config(path, section):
+    """Segments from "<number> = <type> <temperature> <value>" lines."""
+    segments = []
+    count = len([key for key in section if key not in ("slot", "name")])
+    for number in range(1, count + 1):
+        if str(number) not in section:
+            raise OvenError("%s: profile segments have to be numbered 1 to %d" % (path, count))
+        # inline comments are allowed, configparser does not strip them by default
+        fields = section[str(number)].split(";")[0].split()
+        if len(fields) != 3 or fields[0] not in SEGMENT_TYPES[1:]:
+            raise OvenError("%s: segment %d should be <%s> <temperature> <value>"
+                            % (path, number, "|".join(SEGMENT_TYPES[1:])))
+        temperature = float(fields[1])
+        if not 0 < temperature <= SEGMENT_TEMP_MAX:
+            raise OvenError("%s: segment %d goes to %g C, a segment goes above 0 up to %g C"
+                            % (path, number, temperature, SEGMENT_TEMP_MAX))
+        segments.append((fields[0], temperature, float(fields[2])))
+    if not 0 < len(segments) <= PROFILE_SEGMENTS:
+        raise OvenError("%s: a profile has 1 to %d segments" % (path, PROFILE_SEGMENTS))
+    return segments
+
+
+def apply_file(oven, path):
+    config = configparser.ConfigParser()
+    if not config.read(path):
+        raise OvenError("can not read %s" % path)
+    if config.has_section("settings"):
+        # start from what the oven has, so the file only needs the values that change
+        values = oven.read_values("settings", SETTINGS_FIELDS)
+        for field, text in config.items("settings"):
+            if field not in SETTINGS_FIELDS:
+                raise OvenError("%s: unknown settings field %s" % (path, field))
+            values[field] = float(text)
+        oven.write_values("settings", SETTINGS_FIELDS, values)
+        print_values(oven, "settings", values)
+    if config.has_section("profile"):
+        section = config["profile"]
+        segments = profile_from_config(path, section)
+        if "slot" in section:
+            oven.read_slots(int(section["slot"].split(";")[0]))
+        oven.write_profile(segments)
+        if "name" in section:
+            oven.command("name %s" % section["name"].split(";")[0].strip())
+        print_profile(oven, segments)
+
+
+def monitor(oven):
+    oven.command("tele 1")
+    try:
+        while True:
+            line = oven.transport.read_line()
+            if line:
+                print(line, flush=True)
+    except KeyboardInterrupt:
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    target = parser.add_mutually_exclusive_group(required=True)
+    target.add_argument("-p", "--port", action="append", help="serial port, can be given more than once")
+    target.add_argument("--exec", dest="exec_cmd", help="run this program and talk to it over stdin/stdout")
+    parser.add_argument("-b", "--baud", type=int, default=9600)
+    parser.add_argument("-t", "--timeout", type=float, default=3.0, help="seconds to wait for a response")
+    sub = parser.add_subparsers(dest="action", required=True)
+    sub.add_parser("settings", help="print the settings")
+    sub.add_parser("profile", help="print the selected profile")
+    p = sub.add_parser("apply", help="write settings and/or profile from an ini file")
+    p.add_argument("file")
+    p = sub.add_parser("slot", help="print the profile slots, or select one")
+    p.add_argument("value", type=int, nargs="?", choices=range(1, PROFILE_SLOTS + 1))
+    p = sub.add_parser("name", help="rename the selected profile slot")
+    p.add_argument("value")
+    sub.add_parser("runs", help="print how many automatic runs the oven has started")
+    sub.add_parser("mem", help="print the RAM use: static, free now, never reached by the stack")
+    sub.add_parser("start", help="run the selected profile")
+    sub.add_parser("abort", help="turn off and leave the running mode")
+    p = sub.add_parser("temp", help="manual temperature control")
+    p.add_argument("value", type=float)
+    p = sub.add_parser("pwm", help="manual PWM control (0-65535)")
+    p.add_argument("value", type=int)
+    p = sub.add_parser("tele", help="turn the telemetry stream on or off")
+    p.add_argument("value", choices=["on", "off"])
+    sub.add_parser("monitor", help="print the telemetry stream until ctrl-c (single oven only)")
+    sub.add_parser("dump", help="print the recording of the last automatic run, decode it with recdecode.py")
+    sub.add_parser("raw", help="send command lines from stdin, print the responses")
+    args = parser.parse_args()
+
+    if args.exec_cmd:
+        transports = [lambda: ProcessTransport(args.exec_cmd)]
+    else:
+        transports = [lambda port=port: SerialTransport(port, args.baud) for port in args.port]
+    if args.action == "monitor" and len(transports) > 1:
+        parser.error("monitor works on a single oven")
+
+    failed = 0
+    for make_transport in transports:
+        transport = make_transport()
+        oven = Oven(transport, args.timeout)
+        try:
+            if args.action == "settings":
+                print_values(oven, "settings", oven.read_values("settings", SETTINGS_FIELDS))
+            elif args.action == "profile":
+                print_profile(oven, oven.read_profile())
+            elif args.action == "slot":
+                print_slots(oven, *oven.read_slots(args.value))
+            elif args.action == "name":
+                if not 0 < len(args.value) <= PROFILE_NAME_SIZE or "," in args.value:
+                    raise OvenError("a name has 1 to %d characters, without commas" % PROFILE_NAME_SIZE)
+                oven.command("name %s" % args.value)
+            elif args.action == "runs":
+                print("[%s] runs %s" % (transport.name, oven.command("runs")[0].split(",")[1].strip()))
+            elif args.action == "mem":
+                values = oven.read_values("mem", ["static", "free", "stack_unused"])
+                print_values(oven, "mem (bytes)", values)
+            elif args.action == "apply":
+                apply_file(oven, args.file)
+            elif args.action in ("start", "abort"):
+                oven.command(args.action)
+            elif args.action in ("temp", "pwm"):
+                oven.command("%s %g" % (args.action, args.value))
+            elif args.action == "tele":
+                oven.command("tele %d" % (args.value == "on"))
+            elif args.action == "monitor":
+                monitor(oven)
+            elif args.action == "dump":
+                for reply in oven.command("dump"):
+                    if reply.startswith("rec,"):
+                        print(reply)
+            elif args.action == "raw":
+                for line in sys.stdin:
+                    for reply in oven.command(line.strip()):
+                        print(reply)
+        except OvenError as e:
+            print("[%s] error: %s" % (transport.name, e), file=sys.stderr)
+            failed += 1
+        finally:
+            transport.close()
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+"""Reflow quality metrics from serial logs.
+
+Reads captured serial logs and prints one CSV row of metrics per run. Understands the
+auto_go log (stage, time, temperature, target, pwm_ocr), the manual PWM log
+(time, temperature, pwm), the manual temperature log (time, temperature, target, pwm) and the
+output of recdecode.py (stage, time, temperature, target). A capture can hold
+any number of runs, they are split on the "... mode ..." lines the firmware prints.
+
+The firmware logs temperatures in C, logs of older firmware in AD595 sensor counts need
+--constant 0.48876 (THERMOCOUPLE_CONSTANT). Metrics per run:
+    peak_c          highest temperature
+    peak_time       time of the peak, from the start of the run
+    above_liquidus  seconds above --liquidus
+    overshoot_c     peak minus the highest setpoint (runs with a setpoint only, for
+                    auto_go the peak_temp of the profile)
+    ramp_<stage>    average heating rate of each auto_go stage (profile segment) in C/s
+                    (least squares), named after the segments of the default profile
+    max_ramp        steepest heating rate over --window seconds
+    settling        seconds from the last setpoint change (manual) or soak entry (auto)
+                    until the temperature stays within --band of the setpoint
+    pwm_full        seconds at 100 % duty cycle
+    pwm_off         seconds at 0 % duty cycle, while the run was not done
+
+Examples:
+    reflowstats.py logs/*.txt > metrics.csv              # files are processed in parallel
+    reflowctl.py -p COM3 monitor | reflowstats.py -      # streaming, a row per finished run
+"""
+
+import argparse
+import multiprocessing
+import sys
+
+LOG_CONSTANT = 1.0  # C per logged temperature unit
+PWM_FULL = 65535 - 127  # heat_set drops the low 7 bits, so this is already 100 %
+STAGES = ["preheat", "soak", "reflow", "peak", "cool"]  # the segments of the default profile
+STAGE_DONE = 8  # REFLOW_STAGE_DONE, PROFILE_SEGMENTS in include/reflowtoasteroven.h
+COLUMNS = (["file", "run", "mode", "duration", "peak_c", "peak_time", "above_liquidus", "overshoot_c"]
+           + ["ramp_" + s for s in STAGES]
+           + ["max_ramp", "settling", "pwm_full", "pwm_off"])
+
+MODE_LINES = {
+    "auto mode session start": "auto",
+    "manual PWM control mode": "pwm",
+    "manual temperature control mode": "temp",
+    "autotune mode": "temp",  # same columns, the setpoint is the temperature it tunes around
+}
+
+
+class Run:
+    def __init__(self, mode):
+        self.mode = mode
+        self.time = []
+        self.temp = []
+        self.setpoint = []  # C, None if the log has no setpoint
+        self.stage = []
+        self.pwm = []  # None if the log has no pwm
+
+    def add(self, fields, constant):
+        """Add one CSV row, returns False if it does not fit this kind of run."""
+        try:
+            values = [float(f) for f in fields]
+        except ValueError:
+            return False
+        n = len(values)
+        if self.mode == "auto" and n in (5, 6):
+            stage, t, sensor, target, pwm = values[:5]  # the 6th is the air thermocouple, with SENSOR_CHANNELS 2
+        elif self.mode == "record" and n == 4:
+            stage, t, sensor, target = values
+            pwm = None
+        elif self.mode == "pwm" and n == 3:
+            t, sensor, pwm = values
+            stage, target = None, None
+        elif self.mode == "temp" and n == 4:
+            t, sensor, target, pwm = values
+            stage = None
+            target /= constant  # older firmware logged this setpoint in C already
+        else:
+            return False
+        self.time.append(t)
+        self.temp.append(sensor * constant)
+        self.setpoint.append(None if target is None else target * constant)
+        self.stage.append(None if stage is None else int(stage))
+        self.pwm.append(pwm)
+        return True
+
+    def metrics(self, liquidus, band, window):
+        t, temp = self.time, self.temp
+        m = {"mode": self.mode, "duration": t[-1] - t[0]}
+
+        peak = max(range(len(temp)), key=temp.__getitem__)
+        m["peak_c"] = temp[peak]
+        m["peak_time"] = t[peak] - t[0]
+        m["above_liquidus"] = sum((dt for dt, x in zip(intervals(t), temp) if x >= liquidus), 0.0)
+
+        # stage 3 of the default profile waits for the peak and aims 5 C past it, the peak is the end of stage 2
+        setpoints = [s for s, stage in zip(self.setpoint, self.stage) if s is not None and stage != 3]
+        if setpoints:
+            m["overshoot_c"] = temp[peak] - max(setpoints)
+
+        if self.stage[0] is not None:
+            for number, name in enumerate(STAGES):
+                idx = [i for i, s in enumerate(self.stage) if s == number]
+                if len(idx) >= 2:
+                    m["ramp_" + name] = slope([t[i] for i in idx], [temp[i] for i in idx])
+
+        m["max_ramp"] = max_slope(t, temp, window)
+
+        m["settling"] = self.settling(band)
+
+        if self.pwm[0] is not None:
+            active = [s is None or s < STAGE_DONE for s in self.stage]
+            dts = intervals(t)
+            m["pwm_full"] = sum((dt for dt, p in zip(dts, self.pwm) if p >= PWM_FULL), 0.0)
+            m["pwm_off"] = sum((dt for dt, p, a in zip(dts, self.pwm, active) if p == 0 and a), 0.0)
+        return m
+
+    def settling(self, band):
+        """Seconds from the reference point until the error stays within band, None if it never does."""
+        if self.setpoint[0] is None:
+            return None
+        if self.stage[0] is not None:
+            # auto run: from entering soak, until the end of soak
+            idx = [i for i, s in enumerate(self.stage) if s == 1]
+        else:
+            # manual temperature: from the last setpoint change until the end
+            last_change = 0
+            for i in range(1, len(self.setpoint)):
+                if self.setpoint[i] != self.setpoint[i - 1]:
+                    last_change = i
+            idx = list(range(last_change, len(self.setpoint)))
+        if not idx:
+            return None
+        settled = None
+        for i in idx:
+            if abs(self.temp[i] - self.setpoint[i]) > band:
+                settled = None
+            elif settled is None:
+                settled = i
+        return None if settled is None else self.time[settled] - self.time[idx[0]]
+
+
+def intervals(t):
+    """Duration each sample stands for, the last one gets the previous interval."""
+    if len(t) < 2:
+        return [0.0] * len(t)
+    d = [b - a for a, b in zip(t, t[1:])]
+    return d + [d[-1]]
+
+
+def slope(x, y):
+    n = len(x)
+    mx, my = sum(x) / n, sum(y) / n
+    sxx = sum((a - mx) ** 2 for a in x)
+    if sxx == 0:
+        return None
+    return sum((a - mx) * (b - my) for a, b in zip(x, y)) / sxx
+
+
+def max_slope(t, temp, window):
+    best = None
+    j = 0
+    for i in range(len(t)):
+        while t[i] - t[j] > window:
+            j += 1
+        if t[i] - t[j] >= window / 2:
+            rate = (temp[i] - temp[j]) / (t[i] - t[j])
+            best = rate if best is None else max(best, rate)
+    return best
+
+
+def runs_from_lines(lines, constant):
+    """Split a log into runs, yields each run as soon as it is complete."""
+    run = None
+    for line in lines:
+        line = line.strip().rstrip(",")
+        if not line:
+            continue
+        if line in MODE_LINES:
+            if run is not None and run.time:
+                yield run
+            run = Run(MODE_LINES[line])
+            continue
+        fields = [f.strip() for f in line.split(",")]
+        if not fields[0][:1].isdigit():
+            continue  # menu messages and command responses
+        if run is None:
+            # no mode line, must be the output of recdecode.py
+            run = Run("record")
+        if not run.add(fields, constant) and run.time:
+            # different kind of line, the previous run has ended
+            yield run
+            run = None
+    if run is not None and run.time:
+        yield run
+
+
+def format_row(name, number, metrics):
+    row = [name, str(number)]
+    for column in COLUMNS[2:]:
+        value = metrics.get(column)
+        if value is None:
+            row.append("")
+        elif isinstance(value, float):
+            row.append("%.2f" % value)
+        else:
+            row.append(str(value))
+    return ", ".join(row)
+
+
+def process_file(job):
+    path, args = job
+    rows = []
+    with open(path, errors="replace") as f:
+        for number, run in enumerate(runs_from_lines(f, args.constant)):
+            rows.append(format_row(path, number, run.metrics(args.liquidus, args.band, args.window)))
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("files", nargs="+", help="log files, - for stdin (streaming)")
+    parser.add_argument("--liquidus", type=float, default=217.0, help="liquidus temperature in C, default 217 (SAC305)")
+    parser.add_argument("--band", type=float, default=3.0, help="settling band in C, default 3")
+    parser.add_argument("--window", type=float, default=10.0, help="window for max_ramp in seconds, default 10")
+    parser.add_argument("--constant", type=float, default=LOG_CONSTANT, help="C per logged unit, 0.48876 for older logs in sensor counts")
+    parser.add_argument("-j", "--jobs", type=int, default=None, help="parallel processes, default one per CPU")
+    args = parser.parse_args()
+
+    print(", ".join(COLUMNS))
+
+    if args.files == ["-"]:
+        for number, run in enumerate(runs_from_lines(sys.stdin, args.constant)):
+            print(format_row("-", number, run.metrics(args.liquidus, args.band, args.window)), flush=True)
+        return
+
+    jobs = [(path, args) for path in args.files]
+    if len(jobs) == 1 or args.jobs == 1:
+        results = map(process_file, jobs)
+    else:
+        pool = multiprocessing.Pool(args.jobs)
+        results = pool.imap(process_file, jobs, chunksize=16)
+    for rows in results:
+        for row in rows:
+            print(row)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,356 @@
+/* Trace replay harness
+ *
+ * Feeds the temperature column of an auto_go CSV log into the real reflow state machine
+ * (src/reflowcontrol.cpp, with sensor_read() replaced by the trace) and checks that the
+ * regenerated stage, target temperature and pwm_ocr columns match the log.
+ *
+ *   replay [options] <settings.ini> <log.csv>...
+ *   replay --simulate <file.ini>...
+ *
+ *   --write          print the regenerated log instead of checking, to (re)make a golden trace
+ *   --pwm-tol <n>    allowed pwm_ocr difference, default 128 (one step of heat_set)
+ *   --set-tol <n>    allowed target temperature difference in 0.1 C, default 1
+ *   --simulate       run the state machine against the [model] from tools/ovenmodel.py instead
+ *                    of a log, and print the log the oven would make
+ *
+ * The ini file has the same [settings] and [profile] sections as tools/reflowctl.py uses,
+ * these have to be the values the log was made with. Logs made on the oven are compared with
+ * tolerances because doubles are only 32 bit on the AVR. With --simulate the ini files are
+ * read in order, so a later one overrides the suggested settings of the model file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "reflowtoasteroven.h"
+#include "temperaturemeasurement.h"
+#include "reflowcontrol.h"
+
+settings_t settings;
+volatile uint8_t ADCL, ADCH, ADMUX, ADCSRA, ADCSRB, DIDR0;
+
+struct model_t
+{
+	int order;
+	double gain; // C above ambient at 100 % duty cycle
+	double tau1; // s
+	double tau2; // s, order 2 only
+	double dead_time;
+	double ambient;
+};
+
+struct row_t
+{
+	int line;
+	int stage;
+	double time;
+	long sensor;   // 0.1 C
+	long setpoint; // 0.1 C
+	long pwm;
+};
+
+static int load_ini(const char *path, profile_t *profile, model_t *model)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		fprintf(stderr, "can not read %s\n", path);
+		return 0;
+	}
+
+	static const char *segment_types[SEGMENT_TYPES] = {"end", "ramp", "ramp_time", "hold", "wait", "cool"};
+	char line[128];
+	int in_model = 0;
+	int segments = 0;
+	while (fgets(line, sizeof(line), f))
+	{
+		char key[64];
+		double value;
+		int number;
+		double temp;
+		if (sscanf(line, " [%63[a-z]]", key) == 1)
+		{
+			in_model = !strcmp(key, "model");
+			continue;
+		}
+		if (sscanf(line, " %d = %63[a-z_] %lf %lf", &number, key, &temp, &value) == 4)
+		{
+			// profile segment, numbered from 1, a file with segments replaces the whole profile
+			int type = 0;
+			while (type < SEGMENT_TYPES && strcmp(key, segment_types[type]))
+			{
+				type++;
+			}
+			if (type == SEGMENT_TYPES || number < 1 || number > PROFILE_SEGMENTS)
+			{
+				fprintf(stderr, "%s: bad segment %s", path, line);
+				fclose(f);
+				return 0;
+			}
+			if (segments++ == 0)
+			{
+				for (int i = 0; i < PROFILE_SEGMENTS; i++)
+				{
+					segment_set(&profile->seg[i], SEGMENT_END, 0.0, 0.0);
+				}
+			}
+			segment_set(&profile->seg[number - 1], (uint8_t)type, temp, value);
+			continue;
+		}
+		if (sscanf(line, " %63[a-z_0-9] = %lf", key, &value) != 2)
+		{
+			continue; // comments
+		}
+		if (in_model)
+		{
+			if (!strcmp(key, "order")) model->order = (int)value;
+			else if (!strcmp(key, "gain")) model->gain = value;
+			else if (!strcmp(key, "tau1")) model->tau1 = value;
+			else if (!strcmp(key, "tau2")) model->tau2 = value;
+			else if (!strcmp(key, "dead_time")) model->dead_time = value;
+			else if (!strcmp(key, "ambient")) model->ambient = value;
+			else key[0] = 0;
+		}
+		else if (!strcmp(key, "pid_p")) settings.pid_p = value;
+		else if (!strcmp(key, "pid_i")) settings.pid_i = value;
+		else if (!strcmp(key, "pid_d")) settings.pid_d = value;
+		else if (!strcmp(key, "max_temp")) settings.max_temp = value;
+		else if (!strcmp(key, "time_to_max")) settings.time_to_max = value;
+		else if (!strcmp(key, "pid_p_hot")) settings.pid_p_hot = value;
+		else if (!strcmp(key, "pid_i_hot")) settings.pid_i_hot = value;
+		else if (!strcmp(key, "pid_d_hot")) settings.pid_d_hot = value;
+		else if (!strcmp(key, "sched_low")) settings.sched_low = value;
+		else if (!strcmp(key, "sched_high")) settings.sched_high = value;
+		else if (!strcmp(key, "slot")) continue; // the profile slot on the oven, and the name is not a number
+		else key[0] = 0;
+
+		if (!key[0])
+		{
+			fprintf(stderr, "%s: unknown key in %s", path, line);
+			fclose(f);
+			return 0;
+		}
+	}
+	fclose(f);
+	if (!profile_valid(profile))
+	{
+		fprintf(stderr, "%s: invalid profile\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+// reads the auto_go sessions from a log, the rows of each session in a separate list
+static std::vector<std::vector<row_t> > load_log(const char *path)
+{
+	std::vector<std::vector<row_t> > sessions;
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		fprintf(stderr, "can not read %s\n", path);
+		return sessions;
+	}
+
+	char line[256];
+	int number = 0;
+	int in_session = 0;
+	while (fgets(line, sizeof(line), f))
+	{
+		number++;
+		row_t row;
+		double sensor, setpoint;
+		if (strncmp(line, "auto mode session start", 23) == 0)
+		{
+			sessions.push_back(std::vector<row_t>());
+			in_session = 1;
+		}
+		else if (sscanf(line, "%d, %lf, %lf, %lf, %ld", &row.stage, &row.time, &sensor, &setpoint, &row.pwm) == 5)
+		{
+			row.sensor = lround(sensor * 10.0);
+			row.setpoint = lround(setpoint * 10.0);
+			if (!in_session)
+			{
+				// log without the start line
+				sessions.push_back(std::vector<row_t>());
+				in_session = 1;
+			}
+			row.line = number;
+			sessions.back().push_back(row);
+		}
+		else if (strstr(line, "mode") != 0)
+		{
+			in_session = 0; // some other mode, its lines are not ours
+		}
+	}
+	fclose(f);
+	return sessions;
+}
+
+static int replay(const char *path, std::vector<row_t> &rows, profile_t *profile, int write, long pwm_tol, long set_tol)
+{
+	const double tick = TMR_OVF_TIMESPAN * 256;
+	reflow_t r;
+	int mismatches = 0;
+
+	// the reading auto_go starts with is not logged, the first logged one is the closest there is
+	reflow_init(&r, profile, rows[0].sensor);
+	if (write)
+	{
+		printf("auto mode session start,\n");
+	}
+
+	for (size_t i = 0; i < rows.size(); i++)
+	{
+		row_t &row = rows[i];
+
+		// the log can skip lines (telemetry turned off), keep feeding the last reading
+		uint32_t cnt = (uint32_t)lround(row.time / tick);
+		int16_t sensor = (int16_t)(i > 0 ? rows[i - 1].sensor : row.sensor);
+		while (r.total_cnt + 1 < cnt)
+		{
+			reflow_step(&r, sensor);
+		}
+		reflow_step(&r, (int16_t)row.sensor);
+
+		long setpoint = r.tgt_temp;
+		if (write)
+		{
+			printf("%d, %.1f, %.1f, %.1f, %u,\n", r.stage, r.total_cnt * tick, row.sensor / 10.0, setpoint / 10.0, r.pwm_ocr);
+			continue;
+		}
+
+		if (r.stage != row.stage || labs(setpoint - row.setpoint) > set_tol || labs((long)r.pwm_ocr - row.pwm) > pwm_tol)
+		{
+			if (mismatches < 10)
+			{
+				printf("%s:%d: expected %d, %ld, %ld but got %d, %ld, %u\n", path, row.line,
+					   row.stage, row.setpoint, row.pwm, r.stage, setpoint, r.pwm_ocr);
+			}
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+// closed loop run against the model, one heat_set() duty cycle per tick like auto_go
+static int simulate(model_t *model, profile_t *profile)
+{
+	const double tick = TMR_OVF_TIMESPAN * 256;
+	if (model->tau1 <= 0 || (model->order == 2 && model->tau2 <= 0))
+	{
+		fprintf(stderr, "no usable [model] section\n");
+		return 1;
+	}
+
+	// duty cycles still on their way to the thermocouple
+	size_t delay = (size_t)lround(model->dead_time / tick);
+	std::vector<double> pipeline(delay + 1, 0.0);
+	double element = model->ambient, oven = model->ambient;
+
+	reflow_t r;
+	reflow_init(&r, profile, temperature_to_deci(oven));
+	printf("auto mode session start,\n");
+	while (r.stage != REFLOW_STAGE_DONE && r.total_cnt < 7200)
+	{
+		int16_t sensor = temperature_to_deci(oven);
+		reflow_step(&r, sensor);
+		printf("%d, %.1f, %.1f, %.1f, %u,\n", r.stage, r.total_cnt * tick, sensor / 10.0, r.tgt_temp / 10.0, r.pwm_ocr);
+
+		pipeline[r.total_cnt % pipeline.size()] = (r.pwm_ocr >> 7) / 512.0;
+		double duty = pipeline[(r.total_cnt + 1) % pipeline.size()];
+		double target = model->ambient + model->gain * duty;
+		element = target + (element - target) * exp(-tick / model->tau1);
+		oven = model->order == 2 ? element + (oven - element) * exp(-tick / model->tau2) : element;
+	}
+	return r.stage != REFLOW_STAGE_DONE;
+}
+
+int main(int argc, char **argv)
+{
+	int write = 0;
+	int sim = 0;
+	long pwm_tol = 128;
+	long set_tol = 1;
+	int arg = 1;
+
+	for (; arg < argc && argv[arg][0] == '-'; arg++)
+	{
+		if (!strcmp(argv[arg], "--write"))
+		{
+			write = 1;
+		}
+		else if (!strcmp(argv[arg], "--simulate"))
+		{
+			sim = 1;
+		}
+		else if (!strcmp(argv[arg], "--pwm-tol") && arg + 1 < argc)
+		{
+			pwm_tol = atol(argv[++arg]);
+		}
+		else if (!strcmp(argv[arg], "--set-tol") && arg + 1 < argc)
+		{
+			set_tol = atol(argv[++arg]);
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if (argc - arg < (sim ? 1 : 2))
+	{
+		fprintf(stderr, "usage: replay [--write] [--pwm-tol n] [--set-tol n] <settings.ini> <log.csv>...\n"
+						"       replay --simulate <file.ini>...\n");
+		return 2;
+	}
+
+	profile_t profile;
+	model_t model = {1, 0.0, 0.0, 0.0, 0.0, ROOM_TEMP};
+	settings_setdefault(&settings);
+	profile_setdefault(&profile);
+	if (sim)
+	{
+		for (; arg < argc; arg++)
+		{
+			if (!load_ini(argv[arg], &profile, &model))
+			{
+				return 2;
+			}
+		}
+		return simulate(&model, &profile);
+	}
+
+	if (!load_ini(argv[arg++], &profile, &model))
+	{
+		return 2;
+	}
+
+	int failed = 0;
+	for (; arg < argc; arg++)
+	{
+		std::vector<std::vector<row_t> > sessions = load_log(argv[arg]);
+		if (sessions.empty())
+		{
+			fprintf(stderr, "%s: no auto mode log found\n", argv[arg]);
+			failed = 1;
+			continue;
+		}
+		for (size_t s = 0; s < sessions.size(); s++)
+		{
+			if (sessions[s].empty())
+			{
+				continue;
+			}
+			int mismatches = replay(argv[arg], sessions[s], &profile, write, pwm_tol, set_tol);
+			if (!write)
+			{
+				printf("%s: session %u, %u rows, %d mismatches\n", argv[arg], (unsigned)s, (unsigned)sessions[s].size(), mismatches);
+			}
+			failed |= mismatches != 0;
+		}
+	}
+	return failed;
+}
@@ -0,0 +1,15 @@
+// reads the EEPROM of the avr/io.h shim
+#ifndef shim_avr_eeprom_h
+#define shim_avr_eeprom_h
+
+#include <stdint.h>
+#include <avr/io.h>
+
+static inline uint8_t eeprom_read_byte(const uint8_t *addr)
+{
+	return eeprom[(uintptr_t)addr & E2END];
+}
+
+#define eeprom_busy_wait() // every write is done at once
+
+#endif
@@ -0,0 +1,7 @@
+// interrupt handlers become plain functions, the replay never calls them, the unit tests do
+#ifndef shim_avr_interrupt_h
+#define shim_avr_interrupt_h
+
+#define ISR(vector) void vector(void)
+
+#endif
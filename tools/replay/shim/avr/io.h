@@ -0,0 +1,79 @@
+// just enough of avr/io.h to compile the firmware's hardware independent parts on a PC
+// the registers are plain variables, test/fake_avr.h has them for the unit tests
+#ifndef shim_avr_io_h
+#define shim_avr_io_h
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+#ifndef F_CPU
+#define F_CPU 8000000UL // board_build.f_cpu
+#endif
+
+extern volatile uint8_t ADCL, ADCH, ADMUX, ADCSRA, ADCSRB, DIDR0;
+
+#define ADEN 7
+#define ADSC 6
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define REFS0 6
+
+// the pins, see board.h
+extern volatile uint8_t PORTB, DDRB, PINB, PORTC, DDRC, PINC, PORTD, DDRD, PIND;
+
+// the EEPROM, a byte is written as soon as EEPE is set
+#define EERE 0
+#define EEPE 1
+#define EEMPE 2
+#define EERIE 3
+#define E2END 1023
+
+extern uint8_t eeprom[E2END + 1];
+extern volatile uint16_t EEAR;
+extern volatile uint8_t EEDR;
+
+// the interrupts, the tests call them by hand, except the EEPROM ready one, see eecr_t
+void ADC_vect(void);
+void EE_READY_vect(void);
+
+// so nothing waits for the EEPROM, the ready interrupt runs for as long as it is enabled
+struct eecr_t
+{
+	uint8_t bits;
+
+	eecr_t &operator|=(uint8_t set)
+	{
+		bits |= set;
+		if (bits & _BV(EERE))
+		{
+			EEDR = eeprom[EEAR & E2END];
+			bits &= ~_BV(EERE);
+		}
+		if ((bits & _BV(EEPE)) && (bits & _BV(EEMPE)))
+		{
+			eeprom[EEAR & E2END] = EEDR;
+			bits &= ~(_BV(EEPE) | _BV(EEMPE));
+		}
+		if (set & _BV(EERIE))
+		{
+			while (bits & _BV(EERIE))
+			{
+				EE_READY_vect();
+			}
+		}
+		return *this;
+	}
+
+	eecr_t &operator&=(uint8_t keep)
+	{
+		bits &= keep;
+		return *this;
+	}
+};
+
+extern eecr_t EECR;
+
+#endif
@@ -0,0 +1,10 @@
+// tables in flash are plain tables on the host
+#ifndef shim_avr_pgmspace_h
+#define shim_avr_pgmspace_h
+
+#include <string.h>
+
+#define PROGMEM
+#define memcpy_P memcpy
+
+#endif
@@ -0,0 +1,36 @@
+// the C library on the PC does not have ltoa() and ultoa() of avr-libc
+#ifndef shim_stdlib_h
+#define shim_stdlib_h
+
+#include_next <stdlib.h>
+
+static inline char *ultoa(unsigned long value, char *s, int radix)
+{
+	char *end = s;
+	do
+	{
+		*end++ = "0123456789abcdefghijklmnopqrstuvwxyz"[value % radix];
+		value /= radix;
+	} while (value != 0);
+	*end = 0;
+	for (char *a = s, *b = end - 1; a < b; a++, b--)
+	{
+		char c = *a;
+		*a = *b;
+		*b = c;
+	}
+	return s;
+}
+
+static inline char *ltoa(long value, char *s, int radix)
+{
+	if (value < 0 && radix == 10)
+	{
+		*s = '-';
+		ultoa(-(unsigned long)value, s + 1, radix);
+		return s;
+	}
+	return ultoa(value, s, radix);
+}
+
+#endif
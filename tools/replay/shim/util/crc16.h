@@ -0,0 +1,14 @@
+// the C version avr-libc gives for its assembler one
+#ifndef shim_util_crc16_h
+#define shim_util_crc16_h
+
+#include <stdint.h>
+
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return (((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3);
+}
+
+#endif
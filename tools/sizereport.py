@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""Static RAM per module and flash per symbol of a PlatformIO build.
+
+RAM comes from the linker map, written by the -Wl,-Map flag in platformio.ini, build first
+(pio run). Only what the linker kept is counted: .data (initialised variables and the strings
+that are not in PROGMEM), .bss and .noinit of every object file. What is left of the 2048 bytes
+is shared by the heap and the stack, the serial command "mem" tells how much of it the stack
+has used.
+
+--flash lists the functions and the initialised data of firmware.elf by size (avr-nm) and
+compares them with sizebudget.ini: a symbol over its budget, or .text plus .data over the
+total, is a regression and makes the exit status 1. A budget without any symbols in it can not
+be checked against and makes the exit status 2, like a missing build, so the check neither passes
+nor reports a regression until the budget has been recorded with --update.
+
+Examples:
+    sizereport.py                         # .pio/build/ATmega328/firmware.map
+    sizereport.py --env bench
+    sizereport.py --map firmware.map --top 10
+    sizereport.py --flash --top 20
+    sizereport.py --flash --update        # record the current sizes plus --margin as the budget
+"""
+
+import argparse
+import collections
+import configparser
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+ROOT = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+RAM_SIZE = 2048  # ATmega328
+FLASH_SIZE = 32768  # no bootloader, it is programmed over ISP
+RAM_SECTIONS = (".data", ".bss", ".noinit")
+FLASH_SECTIONS = (".text", ".data")  # .data is copied from flash at reset
+FLASH_TYPES = "tTwWdD"  # avr-nm types of code, PROGMEM tables (in .text) and initialised data
+BUDGET = os.path.join(os.path.dirname(os.path.abspath(__file__)), "sizebudget.ini")
+
+
+def module_name(path):
+    """main.cpp for .pio/build/ATmega328/src/main.cpp.o, libc.a(printf.o) for archive members."""
+    member = re.search(r"([^/\\]+)\(([^)]+)\)$", path)
+    if member:
+        return "%s(%s)" % (member.group(1), re.sub(r"\.o$", "", member.group(2)))
+    return re.sub(r"\.o$", "", os.path.basename(path))
+
+
+def input_sections(path):
+    """Yield (output section, input section, size, object file) for everything the linker kept."""
+    with open(path, errors="replace") as f:
+        lines = f.read().split("\n")
+    try:
+        start = lines.index("Linker script and memory map")
+    except ValueError:
+        raise SystemExit("%s: not a linker map" % path)
+    output = None
+    pending = None  # an input section name too long to share its line with the address
+    for line in lines[start + 1:]:
+        if not line.strip():
+            continue
+        if not line[0].isspace():
+            output = line.split()[0]
+            pending = None
+            continue
+        tokens = line.split()
+        is_name = tokens[0].startswith(".") or tokens[0] == "COMMON"
+        if len(tokens) == 1 and is_name:
+            pending = tokens[0]
+            continue
+        if pending and len(tokens) >= 3 and tokens[0].startswith("0x") and tokens[1].startswith("0x"):
+            yield output, pending, int(tokens[1], 16), " ".join(tokens[2:])
+        elif is_name and len(tokens) >= 4 and tokens[1].startswith("0x") and tokens[2].startswith("0x"):
+            yield output, tokens[0], int(tokens[2], 16), " ".join(tokens[3:])
+        pending = None
+
+
+def output_sizes(path):
+    """Sizes of the output sections, {".text": bytes, ...}."""
+    sizes = collections.Counter()
+    with open(path, errors="replace") as f:
+        for line in f:
+            tokens = line.split()
+            if line[:1] == "." and len(tokens) >= 3 and tokens[1].startswith("0x") and tokens[2].startswith("0x"):
+                sizes[tokens[0]] += int(tokens[2], 16)
+    return sizes
+
+
+def find_nm(nm):
+    if shutil.which(nm):
+        return nm
+    packaged = os.path.join(os.path.expanduser("~"), ".platformio", "packages", "toolchain-atmelavr", "bin", nm)
+    if os.path.exists(packaged) or os.path.exists(packaged + ".exe"):
+        return packaged
+    raise SystemExit("%s not found, give --nm" % nm)
+
+
+def flash_symbols(elf, nm):
+    """{name: bytes} of the symbols that take flash, names demangled."""
+    output = subprocess.run([find_nm(nm), "--size-sort", "-S", "-C", elf], stdout=subprocess.PIPE,
+                            text=True, check=True).stdout
+    symbols = collections.Counter()
+    for line in output.splitlines():
+        parts = line.split(None, 3)
+        if len(parts) == 4 and parts[2] in FLASH_TYPES:
+            symbols[parts[3]] += int(parts[1], 16)
+    return symbols
+
+
+def flash_report(path, elf, nm, top, budget_path, update, margin):
+    total = sum(size for name, size in output_sizes(path).items() if name in FLASH_SECTIONS)
+    symbols = flash_symbols(elf, nm)
+    budget = configparser.ConfigParser(delimiters=(" = ",), comment_prefixes=(";",), interpolation=None)
+    budget.optionxform = str  # symbol names are case sensitive, and C++ ones can have = and : in them
+    budget.read(budget_path)
+    for section in ("total", "symbols"):
+        if not budget.has_section(section):
+            budget.add_section(section)
+    limits = budget["symbols"]
+
+    failed = 0
+    largest = set(name for name, size in symbols.most_common(top or None))
+    print("%6s %6s  %s" % ("bytes", "budget", "symbol"))
+    for name, size in symbols.most_common():
+        limit = int(limits[name]) if name in limits else None
+        over = limit is not None and size > limit
+        if over:
+            failed += 1
+        if over or name in largest:
+            print("%6d %6s  %s%s" % (size, "-" if limit is None else limit, name, "  REGRESSION" if over else ""))
+    flash = int(budget["total"].get("flash", FLASH_SIZE))
+    print("%6d %6d  .text and .data of %s" % (total, flash, elf))
+    if total > flash:
+        print("the firmware is over its flash budget by %d bytes" % (total - flash))
+        failed += 1
+    if not limits and not update and not failed:
+        print("error: %s has no symbol budgets, record them with --update on a known good build" % budget_path,
+              file=sys.stderr)
+        return 2
+
+    if update:
+        for name, size in symbols.items():
+            limits[name] = str(int(size * (1 + margin / 100.0) + 0.5))
+        budget["total"]["flash"] = str(flash)
+        with open(budget_path, "w") as f:
+            f.write("; bytes of flash, sizereport.py --flash fails above these, written by sizereport.py --update\n")
+            budget.write(f, space_around_delimiters=False)
+        print("budget written to %s" % budget_path)
+        return 0
+    return 1 if failed else 0
+
+
+def ram_report(path, top):
+    modules = collections.Counter()
+    for output, name, size, obj in input_sections(path):
+        if output in RAM_SECTIONS and size:
+            modules[module_name(obj)] += size
+    total = sum(modules.values())
+    print("%6s  %s" % ("bytes", "module"))
+    for name, size in modules.most_common(top):
+        print("%6d  %s" % (size, name))
+    if top and len(modules) > top:
+        print("%6d  %d more modules" % (sum(size for name, size in modules.most_common()[top:]), len(modules) - top))
+    print("%6d  static RAM of %d, %d left for the heap and the stack" % (total, RAM_SIZE, RAM_SIZE - total))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--env", default="ATmega328", help="PlatformIO environment (default %(default)s)")
+    parser.add_argument("--map", help="linker map, instead of the one of --env")
+    parser.add_argument("--top", type=int, default=0, help="only the largest modules or symbols, and regressions")
+    parser.add_argument("--flash", action="store_true", help="flash per symbol against the budget, instead of RAM")
+    parser.add_argument("--elf", help="firmware for --flash, instead of the one of --env")
+    parser.add_argument("--nm", default="avr-nm", help="avr-nm executable (default %(default)s)")
+    parser.add_argument("--budget", default=BUDGET, help="budget file (default %(default)s)")
+    parser.add_argument("--update", action="store_true", help="write the sizes plus --margin to the budget file")
+    parser.add_argument("--margin", type=float, default=5.0, help="percent above the sizes for --update")
+    args = parser.parse_args()
+
+    build = os.path.join(ROOT, ".pio", "build", args.env)
+    path = args.map or os.path.join(build, "firmware.map")
+    elf = args.elf or os.path.join(build, "firmware.elf")
+    for needed in [path] + ([elf] if args.flash else []):
+        if not os.path.exists(needed):
+            print("error: %s not found, build with pio run first" % needed, file=sys.stderr)
+            return 2
+    if args.flash:
+        return flash_report(path, elf, args.nm, args.top, args.budget, args.update, args.margin)
+    ram_report(path, args.top)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())